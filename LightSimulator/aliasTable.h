@@ -0,0 +1,59 @@
+#pragma once
+#include "pch.h"
+
+/*
+	Walker's alias table, picks an index with a probability proportional to its weight in constant time,
+	no matter how many weights there are. Built with Vose's method in linear time
+*/
+struct aliasTable_t {
+	/* The probability of keeping the column instead of taking its alias */
+	std::vector<double> probability;
+	std::vector<uint32_t> alias;
+
+	/* Weights that are not positive are never picked, if no weight is positive all are picked equally */
+	void build(const std::vector<double>& weights) {
+		size_t count = weights.size();
+		probability.assign(count, 1);
+		alias.resize(count);
+		for (size_t i = 0; i < count; i++) alias[i] = (uint32_t)i;
+		if (count == 0) return;
+
+		double sum = 0;
+		for (auto weight : weights) {
+			if (weight > 0) sum += weight;
+		}
+		if (!(sum > 0)) return;
+
+		std::vector<double> scaled(count);
+		std::vector<uint32_t> small, large;
+		for (size_t i = 0; i < count; i++) {
+			scaled[i] = weights[i] > 0 ? weights[i] * count / sum : 0;
+			(scaled[i] < 1 ? small : large).push_back((uint32_t)i);
+		}
+
+		while (!small.empty() && !large.empty()) {
+			auto less = small.back();
+			small.pop_back();
+			auto more = large.back();
+			probability[less] = scaled[less];
+			alias[less] = more;
+			scaled[more] = (scaled[more] + scaled[less]) - 1;
+			if (scaled[more] < 1) {
+				large.pop_back();
+				small.push_back(more);
+			}
+		}
+		// What is left has a probability of one, up to rounding errors
+		for (auto i : small) probability[i] = 1;
+		for (auto i : large) probability[i] = 1;
+	}
+
+	template <typename R>
+	inline size_t sample(R& random) const {
+		auto value = std::uniform_real_distribution<double>(0, (double)probability.size())(random);
+		auto column = std::min((size_t)value, probability.size() - 1);
+		return value - (double)column < probability[column] ? column : alias[column];
+	}
+
+	inline bool empty() const { return probability.empty(); }
+};
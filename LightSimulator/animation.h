@@ -0,0 +1,62 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+
+/* Where an animated object is at a frame */
+struct keyframe_t {
+	size_t frame = 0;
+	/* Where the center of the object is placed */
+	vec2_t position;
+	/* In radians, relative to the object in the room */
+	extent_t rotation = 0;
+	/* Relative to the object in the room */
+	extent_t scale = 1;
+
+	bool operator==(const keyframe_t& other) const = default;
+};
+
+/* The keyframes of one object. Between two keyframes the values are interpolated linearly, before the first and after the last they are held */
+struct track_t {
+	enum class target_e {
+		spawner,
+		instance,
+		/* Polygons and polylines, by their index in the polygon holder */
+		polygon
+	};
+
+	target_e target = target_e::spawner;
+	size_t index = 0;
+	/* Sorted by frame, never empty */
+	std::vector<keyframe_t> keys;
+
+	inline keyframe_t sample(size_t frame) const {
+		auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](size_t frame, const keyframe_t& key) {
+			return frame < key.frame;
+		});
+		if (next == keys.begin()) return keys.front();
+		if (next == keys.end()) return keys.back();
+
+		auto& a = *(next - 1);
+		auto& b = *next;
+		extent_t t = (extent_t)(frame - a.frame) / (extent_t)(b.frame - a.frame);
+		keyframe_t key;
+		key.frame = frame;
+		key.position = lerp(a.position, b.position, t);
+		key.rotation = a.rotation + (b.rotation - a.rotation) * t;
+		key.scale = a.scale + (b.scale - a.scale) * t;
+		return key;
+	}
+
+	bool operator==(const track_t& other) const = default;
+};
+
+/* Keyframed movement of spawners, instances and polygons, rendered by the sequence command */
+struct animation_t {
+	/* The amount of frames in the sequence, zero if the room is not animated */
+	size_t frames = 0;
+	std::vector<track_t> tracks;
+
+	inline bool isEmpty() const { return frames == 0; }
+
+	bool operator==(const animation_t& other) const = default;
+};
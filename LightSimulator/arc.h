@@ -0,0 +1,58 @@
+#pragma once
+#include "vectors.h"
+#include "shape.h"
+
+/* Part of a circle going counterclockwise from the start angle to the end angle, call update() after changing */
+struct arc_t : public shape_t {
+	vec2_t center;
+	extent_t radius;
+	/* In radians */
+	extent_t start;
+	extent_t end;
+	// Derived from the angles by update()
+	/* The angle the arc spans, in (0, 2 pi] */
+	extent_t span;
+	vec2_t startPoint;
+	vec2_t endPoint;
+	/* Direction pointing to the middle of the arc */
+	vec2_t middle;
+	/* Cosine of half of the angle the arc spans, points with a bigger cosine against the middle are inside the span */
+	extent_t halfSpanCos;
+
+	inline void update() {
+		span = std::fmod(end - start, 2 * 3.14159265358979323846);
+		if (span <= 0) span += 2 * 3.14159265358979323846;
+		startPoint = center + vec2_t(std::cos(start), std::sin(start)) * radius;
+		endPoint = center + vec2_t(std::cos(start + span), std::sin(start + span)) * radius;
+		middle = vec2_t(std::cos(start + span / 2), std::sin(start + span / 2));
+		halfSpanCos = std::cos(span / 2);
+	}
+
+	inline bool isInSpan(const vec2_t& offset) const {
+		auto length = offset.length();
+		return length == 0 || dot(offset, middle) >= halfSpanCos * length;
+	}
+
+	inline extent_t getDist(const vec2_t& p) const override {
+		auto offset = p - center;
+		if (isInSpan(offset)) return std::abs(offset.length() - radius);
+		return std::min((p - startPoint).length(), (p - endPoint).length());
+	}
+
+	inline vec2_t getNormal(const vec2_t& point) const override {
+		auto offset = point - center;
+		if (isInSpan(offset)) {
+			if (offset.isZero()) return middle;
+			return offset.normalize();
+		}
+		// Past the ends the normal of the closer end is used
+		auto closest = (point - startPoint).length() < (point - endPoint).length() ? startPoint : endPoint;
+		return (closest - center).normalize();
+	}
+
+	inline bool isCurved() const override {
+		return true;
+	}
+
+	inline arc_t() : center(0, 0), radius(0), start(0), end(0), span(0), halfSpanCos(1) {};
+};
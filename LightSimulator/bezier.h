@@ -0,0 +1,70 @@
+#pragma once
+#include "vectors.h"
+#include "shape.h"
+
+/* Quadratic Bézier curve from a to b, bent towards the control point */
+struct bezier_t : public shape_t {
+	vec2_t a;
+	vec2_t control;
+	vec2_t b;
+
+	/* Returns the squared distance and the parameter of the closest point on the curve */
+	inline std::pair<extent_t, extent_t> getClosest(const vec2_t& p) const {
+		// Source https://iquilezles.org/www/articles/distfunctions2d/distfunctions2d.htm, the closest point is a root of a cubic
+		vec2_t ab = control - a;
+		vec2_t curve = a - control * 2 + b;
+		vec2_t c = ab * 2;
+		vec2_t d = a - p;
+		auto squared = [](const vec2_t& v) { return dot(v, v); };
+		auto at = [&](extent_t t) { return squared(d + (c + curve * t) * t); };
+
+		extent_t curveLength = dot(curve, curve);
+		// With the control point in the middle the curve is a line and the cubic degenerates
+		if (curveLength < 1e-12) {
+			vec2_t ba = b - a;
+			extent_t t = std::clamp(-dot(d, ba) / dot(ba, ba), 0.0, 1.0);
+			return { squared(d + ba * t), t };
+		}
+
+		extent_t kk = 1 / curveLength;
+		extent_t kx = kk * dot(ab, curve);
+		extent_t ky = kk * (2 * dot(ab, ab) + dot(d, curve)) / 3;
+		extent_t kz = kk * dot(d, ab);
+		extent_t pp = ky - kx * kx;
+		extent_t q = kx * (2 * kx * kx - 3 * ky) + kz;
+		extent_t h = q * q + 4 * pp * pp * pp;
+
+		if (h >= 0) {
+			h = std::sqrt(h);
+			extent_t t = std::clamp(std::cbrt((h - q) / 2) + std::cbrt((-h - q) / 2) - kx, 0.0, 1.0);
+			return { at(t), t };
+		}
+
+		extent_t z = std::sqrt(-pp);
+		extent_t v = std::acos(q / (pp * z * 2)) / 3;
+		extent_t m = std::cos(v);
+		extent_t n = std::sin(v) * 1.732050808;
+		extent_t t1 = std::clamp((m + m) * z - kx, 0.0, 1.0);
+		extent_t t2 = std::clamp((-n - m) * z - kx, 0.0, 1.0);
+		extent_t d1 = at(t1), d2 = at(t2);
+		return d1 < d2 ? std::make_pair(d1, t1) : std::make_pair(d2, t2);
+	}
+
+	inline extent_t getDist(const vec2_t& p) const override {
+		return std::sqrt(getClosest(p).first);
+	}
+
+	inline vec2_t getNormal(const vec2_t& point) const override {
+		auto t = getClosest(point).second;
+		auto tangent = (control - a) * (2 * (1 - t)) + (b - control) * (2 * t);
+		if (tangent.isZero()) tangent = b - a;
+		return tangent.perpendicular().normalize();
+	}
+
+	inline bool isCurved() const override {
+		return true;
+	}
+
+	inline bezier_t(vec2_t a, vec2_t control, vec2_t b) : a(a), control(control), b(b) {};
+	inline bezier_t() : a(0, 0), control(0, 0), b(0, 0) {};
+};
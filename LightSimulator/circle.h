@@ -0,0 +1,31 @@
+#pragma once
+#include "vectors.h"
+#include "shape.h"
+
+/* Distance from the point to the circle, in the precision of the point */
+template <typename T>
+inline T getCircleDist(const basicVec2_t<T>& p, const basicVec2_t<T>& center, T radius) {
+	return std::abs((p - center).length() - radius);
+}
+
+struct circle_t : public shape_t {
+	vec2_t center;
+	extent_t radius;
+
+	inline extent_t getDist(const vec2_t& p) const override {
+		return getCircleDist(p, center, radius);
+	}
+
+	inline vec2_t getNormal(const vec2_t& point) const override {
+		auto offset = point - center;
+		if (offset.isZero()) return vec2_t(1, 0);
+		return offset.normalize();
+	}
+
+	inline bool isCurved() const override {
+		return true;
+	}
+
+	inline circle_t(vec2_t center, extent_t radius) : center(center), radius(radius) {};
+	inline circle_t() : center(0, 0), radius(0) {};
+};
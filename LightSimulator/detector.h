@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+
+/* A line that measures the photons crossing it from either side, the photons pass through it unchanged */
+struct detector_t {
+	vec2_t a;
+	vec2_t b;
+	/* Empty if the detector is only known by its index */
+	std::string name;
+	/* The amount of bins of the histogram of incidence angles, zero for no histogram */
+	size_t bins = 0;
+
+	/*
+		Returns true if the step of a photon from one point to the other crosses the detector. The step
+		may end on the detector but not start on it, so a photon stopping on it is counted once
+	*/
+	inline bool isCrossedBy(const vec2_t& from, const vec2_t& to) const {
+		auto step = to - from;
+		auto line = b - a;
+		auto denominator = step.x * line.y - step.y * line.x;
+		if (denominator == 0) return false;
+		auto offset = a - from;
+		auto t = (offset.x * line.y - offset.y * line.x) / denominator;
+		auto u = (offset.x * step.y - offset.y * step.x) / denominator;
+		return t > 0 && t <= 1 && u >= 0 && u <= 1;
+	}
+
+	/* The histogram bin of a photon crossing in the direction, by its angle to the normal from -90 to 90 degrees */
+	inline size_t getBin(const vec2_t& direction) const {
+		auto tangent = (b - a).normalize();
+		auto angle = std::atan2(dot(direction, tangent), std::abs(dot(direction, tangent.perpendicular())));
+		auto bin = (size_t)((angle / 3.14159265358979323846 + 0.5) * (extent_t)bins);
+		return std::min(bin, bins - 1);
+	}
+
+	bool operator==(const detector_t& other) const = default;
+};
+
+/* What a detector measured during a render */
+struct detectorReading_t {
+	/* The name of the detector, or its index */
+	std::string name;
+	size_t hits = 0;
+	/* The sum of the colours of the photons that crossed */
+	color_t energy;
+	/* Hits per bin of the incidence angle, empty if the detector has no histogram */
+	std::vector<size_t> histogram;
+
+	inline detectorReading_t& operator+=(const detectorReading_t& other) {
+		if (name.empty()) name = other.name;
+		hits += other.hits;
+		energy = energy + other.energy;
+		if (histogram.size() < other.histogram.size()) histogram.resize(other.histogram.size());
+		for (size_t i = 0, len = other.histogram.size(); i < len; i++) {
+			histogram[i] += other.histogram[i];
+		}
+		return *this;
+	}
+};
@@ -0,0 +1,19 @@
+#include "pch.h"
+#include "exceptions.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+std::string except::getWin32ErrStr(unsigned long errNumber) {
+	char* buffer = nullptr;
+	auto length = FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, nullptr, errNumber, 0, (LPSTR)&buffer, 0, nullptr);
+	if (length == 0) return "error " + std::to_string(errNumber);
+	std::string message(buffer, length);
+	LocalFree(buffer);
+	// The messages end with a period and a line break
+	while (!message.empty() && (message.back() == '\n' || message.back() == '\r' || message.back() == '.')) message.pop_back();
+	return message;
+}
+#endif // _WIN32
@@ -4,13 +4,24 @@
 
 namespace except {
 	inline std::string getErrStr(int errNumber) {
+#ifdef _WIN32
 		char buffer[512];
 		strerror_s(buffer, errNumber);
-		return std::string(buffer, 512);
+		return std::string(buffer);
+#else
+		return std::string(strerror(errNumber));
+#endif // _WIN32
 	}
 
+#ifdef _WIN32
+	/* Formats an error code of GetLastError() or WSAGetLastError(), getErrStr() only knows errno values */
+	std::string getWin32ErrStr(unsigned long errNumber);
+#endif // _WIN32
+
 	struct fileOpenFail_ex : std::runtime_error {
 		inline fileOpenFail_ex(const std::string& fileName, int reason) : std::runtime_error("Failed to open file " + fileName + ", " + getErrStr(reason)) {}
+		/* For errors that are not errno values, the reason is the formatted message */
+		inline fileOpenFail_ex(const std::string& fileName, const std::string& reason) : std::runtime_error("Failed to open file " + fileName + ", " + reason) {}
 	};
 
 	struct config_ex : std::runtime_error {
@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "fileWatcher.h"
+#include "exceptions.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // __linux__
+
+namespace {
+	/* How long the file must stay untouched before the change is reported */
+	constexpr auto SETTLE_TIME = std::chrono::milliseconds(50);
+#ifndef __linux__
+	constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+#endif // __linux__
+}
+
+bool fileWatcher_t::poll() {
+	if (!watching) return false;
+	readChanges();
+	if (pending && std::chrono::steady_clock::now() - lastChange >= SETTLE_TIME) {
+		pending = false;
+		return true;
+	}
+	return false;
+}
+
+#ifdef __linux__
+void fileWatcher_t::watch(const std::filesystem::path& file) {
+	stop();
+	path = std::filesystem::absolute(file);
+
+	inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyDescriptor < 0) throw std::runtime_error("Failed to create file watch, " + except::getErrStr(errno));
+
+	// The directory is watched, because editors often save by writing a new file and renaming it over the old one
+	auto directory = path.parent_path();
+	if (inotify_add_watch(inotifyDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0) {
+		auto error = errno;
+		stop();
+		throw std::runtime_error("Failed to watch " + directory.string() + ", " + except::getErrStr(error));
+	}
+
+	watching = true;
+}
+
+void fileWatcher_t::stop() {
+	if (inotifyDescriptor >= 0) close(inotifyDescriptor);
+	inotifyDescriptor = -1;
+	watching = false;
+	pending = false;
+}
+
+void fileWatcher_t::readChanges() {
+	alignas(inotify_event) char buffer[4096];
+	auto name = path.filename().string();
+	while (true) {
+		auto length = read(inotifyDescriptor, buffer, sizeof(buffer));
+		if (length <= 0) break;
+		for (ssize_t offset = 0; offset < length;) {
+			auto event = (const inotify_event*)(buffer + offset);
+			if (event->len > 0 && name == event->name) {
+				pending = true;
+				lastChange = std::chrono::steady_clock::now();
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+}
+#else
+void fileWatcher_t::watch(const std::filesystem::path& file) {
+	stop();
+	path = std::filesystem::absolute(file);
+	std::error_code error;
+	lastWriteTime = std::filesystem::last_write_time(path, error);
+	lastPoll = std::chrono::steady_clock::now();
+	watching = true;
+}
+
+void fileWatcher_t::stop() {
+	watching = false;
+	pending = false;
+}
+
+void fileWatcher_t::readChanges() {
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastPoll < POLL_INTERVAL) return;
+	lastPoll = now;
+
+	// A missing file is not a change, it is most likely being replaced
+	std::error_code error;
+	auto writeTime = std::filesystem::last_write_time(path, error);
+	if (error || writeTime == lastWriteTime) return;
+	lastWriteTime = writeTime;
+	pending = true;
+	lastChange = now;
+}
+#endif // __linux__
@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+
+/*
+	Watches a single file for changes without blocking. On Linux the directory of the file is
+	watched with inotify, so editors that save by replacing the file are detected too, other
+	platforms poll the modification time. Changes are reported once the file was left
+	untouched for a short time, so a save written in several steps is reported once.
+*/
+class fileWatcher_t {
+protected:
+	std::filesystem::path path;
+	bool watching = false;
+	bool pending = false;
+	std::chrono::steady_clock::time_point lastChange;
+#ifdef __linux__
+	int inotifyDescriptor = -1;
+#else
+	std::filesystem::file_time_type lastWriteTime;
+	std::chrono::steady_clock::time_point lastPoll;
+#endif // __linux__
+
+	/* Registers the changes since the last call */
+	void readChanges();
+
+public:
+	/* Starts watching the file, stops watching the previous one. Throws std::runtime_error if the watch cannot be created */
+	void watch(const std::filesystem::path& file);
+	void stop();
+	/* Returns true once after every change, never blocks */
+	bool poll();
+
+	inline bool isWatching() const { return watching; }
+	inline const std::filesystem::path& getPath() const { return path; }
+
+	fileWatcher_t() = default;
+	fileWatcher_t(const fileWatcher_t&) = delete;
+	fileWatcher_t& operator=(const fileWatcher_t&) = delete;
+
+	inline ~fileWatcher_t() {
+		stop();
+	}
+};
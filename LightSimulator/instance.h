@@ -0,0 +1,93 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+#include "shape.h"
+#include "line.h"
+#include "objectHolder.h"
+
+/* Uniform scale, rotation and translation, applied in this order */
+struct transform_t {
+	vec2_t translation;
+	/* In radians, call update() after changing */
+	extent_t rotation = 0;
+	extent_t scale = 1;
+	extent_t cos = 1;
+	extent_t sin = 0;
+
+	inline void update() {
+		cos = std::cos(rotation);
+		sin = std::sin(rotation);
+	}
+
+	inline vec2_t rotate(const vec2_t& direction) const {
+		return vec2_t(direction.x * cos - direction.y * sin, direction.x * sin + direction.y * cos);
+	}
+
+	inline vec2_t toWorld(const vec2_t& point) const {
+		return rotate(point) * scale + translation;
+	}
+
+	inline vec2_t toLocal(const vec2_t& point) const {
+		auto offset = point - translation;
+		return vec2_t(offset.x * cos + offset.y * sin, offset.y * cos - offset.x * sin) * (1 / scale);
+	}
+};
+
+/* A named group of lines placed into the space by instances. Only the geometry of the lines is used, the material is set by the instance. Call update() after changing the lines */
+struct shapeDefinition_t : public objectHolder_t<line_t> {
+	std::string name;
+	// Bounding circle of the lines, derived from them by update()
+	vec2_t center;
+	extent_t radius = 0;
+
+	inline void update() {
+		if (items.empty()) {
+			center = vec2_t();
+			radius = 0;
+			return;
+		}
+		auto min = vec2_t(std::numeric_limits<extent_t>::infinity(), std::numeric_limits<extent_t>::infinity());
+		auto max = -min;
+		for (auto& line : items) {
+			min = vec2_t(std::min({ min.x, line.a.x, line.b.x }), std::min({ min.y, line.a.y, line.b.y }));
+			max = vec2_t(std::max({ max.x, line.a.x, line.b.x }), std::max({ max.y, line.a.y, line.b.y }));
+		}
+		// The circle around the bounding box, it stays a bound when the definition is rotated
+		center = (min + max) * 0.5;
+		radius = (max - min).length() * 0.5;
+	}
+};
+
+/*
+	A shape definition placed with a transform. All instances of a definition share its lines,
+	distance queries transform the point into the space of the definition instead.
+	The scale is uniform, so the distance in the definition only needs to be scaled back
+*/
+struct instance_t : public shape_t {
+	std::shared_ptr<const shapeDefinition_t> definition;
+	transform_t transform;
+
+	/* Distance to the transformed bounding circle of the definition, never bigger than the distance to the instance */
+	inline extent_t getBoundDist(const vec2_t& point) const {
+		return std::max((point - transform.toWorld(definition->center)).length() - definition->radius * transform.scale, (extent_t)0);
+	}
+
+	inline extent_t getDist(const vec2_t& point) const override {
+		return definition->getMinDist(transform.toLocal(point)) * transform.scale;
+	}
+
+	inline std::pair<vec2_t, size_t> getSurface(const vec2_t& point) const override {
+		auto local = transform.toLocal(point);
+		auto closest = definition->getClosest(local).first;
+		if (!closest) return { vec2_t(), 0 };
+		return { transform.rotate(closest->getNormal(local)), (size_t)(closest - definition->items.data()) };
+	}
+
+	inline vec2_t getNormal(const vec2_t& point) const override {
+		return getSurface(point).first;
+	}
+
+	inline size_t getPart(const vec2_t& point) const override {
+		return getSurface(point).second;
+	}
+};
@@ -0,0 +1,556 @@
+#include "pch.h"
+#include "jobServer.h"
+#include "exceptions.h"
+#include "rendering.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace {
+#ifdef _WIN32
+	using socket_t = SOCKET;
+	constexpr socket_t INVALID = INVALID_SOCKET;
+	inline void closeSocket(socket_t socket) { closesocket(socket); }
+	inline int pollSockets(pollfd* fds, size_t count, int timeout) { return WSAPoll(fds, (ULONG)count, timeout); }
+	inline int getSocketError() { return WSAGetLastError(); }
+	inline std::string getSocketErrStr(int error) { return except::getWin32ErrStr((unsigned long)error); }
+#else
+	using socket_t = int;
+	constexpr socket_t INVALID = -1;
+	inline void closeSocket(socket_t socket) { close(socket); }
+	inline int pollSockets(pollfd* fds, size_t count, int timeout) { return poll(fds, (nfds_t)count, timeout); }
+	inline int getSocketError() { return errno; }
+	inline std::string getSocketErrStr(int error) { return except::getErrStr(error); }
+#endif // _WIN32
+
+	/* Removes the socket file left at the path by a previous run, other files are not touched and fail with false */
+	bool removeSocketFile(const std::filesystem::path& path) {
+		std::error_code error;
+		auto status = std::filesystem::symlink_status(path, error);
+		if (!std::filesystem::exists(status)) return true;
+		if (!std::filesystem::is_socket(status)) return false;
+		std::filesystem::remove(path, error);
+		return true;
+	}
+
+	/* How often the listen thread checks if the server was stopped */
+	constexpr int POLL_TIMEOUT = 100;
+	/* How often the progress of the running job is sent */
+	constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(250);
+	/* Lines longer than this are not jobs, the client is disconnected */
+	constexpr size_t MAX_LINE_LENGTH = 1 << 16;
+
+	/* Returns the value of the key, throws except::config_ex if it is missing when required or has the wrong type */
+	template <typename F>
+	const nlohmann::json* getValue(const nlohmann::json& object, const std::string& prefix, const char* name, bool required, F isType, const char* typeName) {
+		auto iter = object.find(name);
+		if (iter == object.end()) {
+			if (required) throw except::configValueMissing_ex(prefix + name);
+			return nullptr;
+		}
+		if (!(iter.value().*isType)()) throw except::configValueMistyped_ex(prefix + name, typeName);
+		return &iter.value();
+	}
+
+	/* Reads an array of count numbers */
+	std::array<extent_t, 4> getNumbers(const nlohmann::json& object, const std::string& prefix, const char* name, size_t count, const char* typeName) {
+		std::array<extent_t, 4> numbers = { 0, 0, 0, 0 };
+		auto& value = *getValue(object, prefix, name, true, &nlohmann::json::is_array, typeName);
+		if (value.size() != count) throw except::configValueMistyped_ex(prefix + name, typeName);
+		for (size_t i = 0; i < count; i++) {
+			if (!value[i].is_number()) throw except::configValueMistyped_ex(prefix + name, typeName);
+			numbers[i] = value[i].get<extent_t>();
+		}
+		return numbers;
+	}
+
+	/* Sets the roughness of the shapes to the value, or back to the roughness of the base space */
+	template <typename T>
+	void setRoughness(std::vector<T>& items, const std::vector<T>& base, std::optional<extent_t> value) {
+		for (size_t i = 0, len = items.size(); i < len; i++) {
+			items[i].roughness = value ? *value : base[i].roughness;
+		}
+	}
+
+	/* Makes the space equal to the base space with the variant applied, without allocating */
+	void applyVariant(space_t& space, const space_t& base, const jobServer_t::variant_t& variant) {
+		setRoughness(space.objectHolder_t<line_t>::items, base.objectHolder_t<line_t>::items, variant.roughness);
+		setRoughness(space.objectHolder_t<instance_t>::items, base.objectHolder_t<instance_t>::items, variant.roughness);
+		setRoughness(space.objectHolder_t<circle_t>::items, base.objectHolder_t<circle_t>::items, variant.roughness);
+		setRoughness(space.objectHolder_t<arc_t>::items, base.objectHolder_t<arc_t>::items, variant.roughness);
+		setRoughness(space.objectHolder_t<bezier_t>::items, base.objectHolder_t<bezier_t>::items, variant.roughness);
+		setRoughness(space.objectHolder_t<polygon_t>::items, base.objectHolder_t<polygon_t>::items, variant.roughness);
+
+		space.spawners = base.spawners;
+		bool ratioChanged = false;
+		for (auto& patch : variant.spawners) {
+			auto& spawner = space.spawners[patch.index];
+			if (patch.color) spawner.color = *patch.color;
+			if (patch.spread) spawner.spread = *patch.spread;
+			if (patch.direction) spawner.direction = *patch.direction;
+			if (patch.ratio) {
+				spawner.ratio = *patch.ratio;
+				ratioChanged = true;
+			}
+		}
+		// The table only depends on the ratios, so it is only rebuilt when they change
+		if (ratioChanged) space.normalizeSpawners();
+		else space.spawnerTable = base.spawnerTable;
+	}
+}
+
+struct jobServer_t::client_t {
+	socket_t socket;
+	std::mutex writeMutex;
+	/* Cleared when the client disconnects, the events of its jobs are then dropped */
+	std::atomic<bool> open = true;
+	/* Data received after the last complete line */
+	std::string buffer;
+	/* Set when the client finished sending, the socket is kept until its jobs are done */
+	bool readClosed = false;
+	/* Jobs of the client that were queued and did not finish yet */
+	std::atomic<size_t> pendingJobs = 0;
+
+	/* Sends the event as one json line, called from both threads */
+	void send(const nlohmann::json& event) {
+		auto line = event.dump() + "\n";
+		std::unique_lock<std::mutex> lock(writeMutex);
+		// Checked under the lock, so the listen thread does not close the socket while it is written to
+		if (!open) return;
+		size_t sent = 0;
+		while (sent < line.size()) {
+#ifdef _WIN32
+			auto length = ::send(socket, line.data() + sent, (int)(line.size() - sent), 0);
+#else
+			auto length = ::send(socket, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+#endif // _WIN32
+			if (length <= 0) {
+				open = false;
+				return;
+			}
+			sent += (size_t)length;
+		}
+	}
+
+	client_t(socket_t socket) : socket(socket) {}
+};
+
+jobServer_t::job_t jobServer_t::parseJob(const nlohmann::json& json) {
+	if (!json.is_object()) throw except::configValueMistyped_ex("(job)", "object");
+	job_t job;
+
+	auto get = [&](const char* name, bool required, auto isType, const char* typeName) -> const nlohmann::json* {
+		return getValue(json, "", name, required, isType, typeName);
+	};
+
+	job.scene = get("scene", true, &nlohmann::json::is_string, "string")->get<std::string>();
+	if (auto value = get("detectorOnly", false, &nlohmann::json::is_boolean, "boolean")) {
+		job.detectorOnly = value->get<bool>();
+	}
+	// Detector only jobs save no image, sweeps still write their manifest
+	if (auto value = get("output", !job.detectorOnly || json.contains("variants"), &nlohmann::json::is_string, "string")) {
+		job.output = value->get<std::string>();
+	}
+
+	auto photons = get("photons", true, &nlohmann::json::is_number, "number")->get<double>();
+	if (!(photons >= 1)) throw except::configValueInvalid_ex("photons", "must be at least one");
+	job.photons = (size_t)photons;
+
+	if (auto value = get("resolution", false, &nlohmann::json::is_number, "number")) {
+		job.resolution = value->get<double>();
+		if (!(job.resolution > 0)) throw except::configValueInvalid_ex("resolution", "must be greater than zero");
+	}
+	if (json.contains("roi")) {
+		auto numbers = getNumbers(json, "", "roi", 4, "[x, y, width, height]");
+		if (!(numbers[2] > 0 && numbers[3] > 0)) throw except::configValueInvalid_ex("roi", "the width and height must be greater than zero");
+		job.region = region_t{ vec2_t(numbers[0], numbers[1]), vec2_t(numbers[2], numbers[3]) };
+	}
+	if (auto value = get("tiled", false, &nlohmann::json::is_string, "string")) {
+		job.tiled = value->get<std::string>();
+	}
+	if (auto value = get("priority", false, &nlohmann::json::is_number, "number")) {
+		job.priority = value->get<int>();
+	}
+	if (auto value = get("threads", false, &nlohmann::json::is_number, "number")) {
+		auto threads = value->get<double>();
+		if (!(threads >= 1)) throw except::configValueInvalid_ex("threads", "must be at least one");
+		job.threads = (size_t)threads;
+	}
+	if (auto value = get("multiplier", false, &nlohmann::json::is_number, "number")) {
+		job.multiplier = value->get<extent_t>();
+		if (!(job.multiplier > 0)) throw except::configValueInvalid_ex("multiplier", "must be greater than zero");
+	}
+	if (auto value = get("seed", false, &nlohmann::json::is_number, "number")) {
+		job.seed = value->get<std::mt19937::result_type>();
+	}
+	if (auto value = get("sort", false, &nlohmann::json::is_number, "number")) {
+		auto interval = value->get<double>();
+		if (!(interval >= 0)) throw except::configValueInvalid_ex("sort", "must not be negative");
+		job.sortInterval = (size_t)interval;
+	}
+
+	if (auto value = get("variants", false, &nlohmann::json::is_array, "object[]")) {
+		for (size_t i = 0, len = value->size(); i < len; i++) {
+			auto& item = (*value)[i];
+			auto prefix = "variants[" + std::to_string(i) + "]";
+			if (!item.is_object()) throw except::configValueMistyped_ex(prefix, "object");
+			prefix += ".";
+			auto& variant = job.variants.emplace_back();
+			variant.parameters = item;
+
+			if (auto number = getValue(item, prefix, "multiplier", false, &nlohmann::json::is_number, "number")) {
+				variant.multiplier = number->get<extent_t>();
+				if (!(*variant.multiplier > 0)) throw except::configValueInvalid_ex(prefix + "multiplier", "must be greater than zero");
+			}
+			if (auto number = getValue(item, prefix, "roughness", false, &nlohmann::json::is_number, "number")) {
+				variant.roughness = number->get<extent_t>();
+			}
+			if (auto patches = getValue(item, prefix, "spawners", false, &nlohmann::json::is_array, "object[]")) {
+				for (size_t j = 0, count = patches->size(); j < count; j++) {
+					auto& patchJson = (*patches)[j];
+					auto patchPrefix = prefix + "spawners[" + std::to_string(j) + "]";
+					if (!patchJson.is_object()) throw except::configValueMistyped_ex(patchPrefix, "object");
+					patchPrefix += ".";
+					auto& patch = variant.spawners.emplace_back();
+
+					auto index = getValue(patchJson, patchPrefix, "index", true, &nlohmann::json::is_number_unsigned, "index")->get<size_t>();
+					patch.index = index;
+					if (patchJson.contains("color")) {
+						auto color = getNumbers(patchJson, patchPrefix, "color", 3, "[r : number, g : number, b : number]");
+						patch.color = color_t(color[0], color[1], color[2]);
+					}
+					if (patchJson.contains("direction")) {
+						auto direction = getNumbers(patchJson, patchPrefix, "direction", 2, "[x : number, y : number]");
+						patch.direction = vec2_t(direction[0], direction[1]);
+					}
+					if (auto number = getValue(patchJson, patchPrefix, "ratio", false, &nlohmann::json::is_number, "number")) {
+						patch.ratio = number->get<extent_t>();
+						if (!(*patch.ratio >= 0)) throw except::configValueInvalid_ex(patchPrefix + "ratio", "must not be negative");
+					}
+					if (auto number = getValue(patchJson, patchPrefix, "spread", false, &nlohmann::json::is_number, "number")) {
+						patch.spread = number->get<extent_t>();
+					}
+				}
+			}
+		}
+	}
+
+	return job;
+}
+
+void jobServer_t::start(const std::filesystem::path& path) {
+	stop();
+
+#ifdef _WIN32
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) throw std::runtime_error("Failed to initialize sockets");
+#endif // _WIN32
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	auto pathString = path.string();
+	if (pathString.size() >= sizeof(address.sun_path)) throw std::runtime_error("Socket path " + pathString + " is too long");
+	std::memcpy(address.sun_path, pathString.c_str(), pathString.size() + 1);
+
+	auto socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socket == INVALID) throw std::runtime_error("Failed to create socket, " + getSocketErrStr(getSocketError()));
+
+	// A socket file left by a previous run would make bind fail
+	if (!removeSocketFile(path)) {
+		closeSocket(socket);
+		throw std::runtime_error("Failed to listen on " + pathString + ", path exists");
+	}
+
+	if (bind(socket, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(socket, SOMAXCONN) != 0) {
+		auto error = getSocketError();
+		closeSocket(socket);
+		throw std::runtime_error("Failed to listen on " + pathString + ", " + getSocketErrStr(error));
+	}
+
+	socketPath = path;
+	listenSocket = (std::intptr_t)socket;
+	running = true;
+	listenThread = std::thread([this]() { listen(); });
+	runThread = std::thread([this]() { run(); });
+}
+
+void jobServer_t::stop() {
+	if (!running) return;
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		running = false;
+		queue = {};
+	}
+	queueChanged.notify_all();
+	if (listenThread.joinable()) listenThread.join();
+	if (runThread.joinable()) runThread.join();
+
+	closeSocket((socket_t)listenSocket);
+	listenSocket = -1;
+	removeSocketFile(socketPath);
+#ifdef _WIN32
+	WSACleanup();
+#endif // _WIN32
+}
+
+size_t jobServer_t::getQueueLength() {
+	std::unique_lock<std::mutex> lock(queueMutex);
+	return queue.size();
+}
+
+void jobServer_t::listen() {
+	std::vector<std::shared_ptr<client_t>> clients;
+	std::vector<pollfd> fds;
+	/* The clients of fds, after the listen socket */
+	std::vector<std::shared_ptr<client_t>> polled;
+
+	while (running) {
+		fds.clear();
+		polled.clear();
+		fds.push_back(pollfd{ (socket_t)listenSocket, POLLIN, 0 });
+		for (auto& client : clients) {
+			if (client->readClosed) continue;
+			fds.push_back(pollfd{ client->socket, POLLIN, 0 });
+			polled.push_back(client);
+		}
+
+		if (pollSockets(fds.data(), fds.size(), POLL_TIMEOUT) > 0) {
+			if (fds[0].revents & POLLIN) {
+				auto socket = accept((socket_t)listenSocket, nullptr, nullptr);
+				if (socket != INVALID) clients.push_back(std::make_shared<client_t>(socket));
+			}
+		}
+
+		for (size_t i = 1, len = fds.size(); i < len; i++) {
+			if (fds[i].revents == 0) continue;
+			auto& client = polled[i - 1];
+			char buffer[4096];
+			auto length = recv(client->socket, buffer, (int)sizeof(buffer), 0);
+			if (length == 0) {
+				// The client may only close its sending side and wait for the events of its jobs
+				client->readClosed = true;
+				continue;
+			} else if (length < 0) {
+				client->open = false;
+				continue;
+			}
+			client->buffer.append(buffer, (size_t)length);
+
+			size_t lineEnd;
+			while ((lineEnd = client->buffer.find('\n')) != std::string::npos) {
+				auto line = client->buffer.substr(0, lineEnd);
+				client->buffer.erase(0, lineEnd + 1);
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				if (!line.empty()) enqueue(line, client);
+			}
+			if (client->buffer.size() > MAX_LINE_LENGTH) {
+				client->send({ { "event", "error" }, { "message", "Line too long" } });
+				client->open = false;
+			}
+		}
+
+		// The jobs of closed clients still run, only the socket is released
+		auto iter = std::remove_if(clients.begin(), clients.end(), [](std::shared_ptr<client_t>& client) {
+			if (client->open && !(client->readClosed && client->pendingJobs == 0)) return false;
+			std::unique_lock<std::mutex> lock(client->writeMutex);
+			closeSocket(client->socket);
+			return true;
+		});
+		clients.erase(iter, clients.end());
+	}
+
+	for (auto& client : clients) {
+		std::unique_lock<std::mutex> lock(client->writeMutex);
+		client->open = false;
+		closeSocket(client->socket);
+	}
+}
+
+void jobServer_t::enqueue(const std::string& line, const std::shared_ptr<client_t>& client) {
+	job_t job;
+	try {
+		job = parseJob(nlohmann::json::parse(line));
+	} catch (const nlohmann::json::exception & err) {
+		client->send({ { "event", "error" }, { "message", err.what() } });
+		return;
+	} catch (const except::config_ex & err) {
+		client->send({ { "event", "error" }, { "message", err.what() } });
+		return;
+	}
+
+	size_t position;
+	client->pendingJobs++;
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		job.id = ++lastId;
+		queue.push(queued_t{ job, client });
+		position = queue.size();
+	}
+	queueChanged.notify_one();
+	client->send({ { "event", "queued" }, { "id", job.id }, { "queueLength", position } });
+}
+
+void jobServer_t::run() {
+	while (true) {
+		queued_t next;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueChanged.wait(lock, [this]() { return !running || !queue.empty(); });
+			if (!running) return;
+			next = queue.top();
+			queue.pop();
+		}
+
+		spdlog::info("Job {} started, {} photons of {}", next.job.id, next.job.photons, next.job.scene.string());
+		try {
+			render(next.job, *next.client);
+		} catch (const std::exception & err) {
+			spdlog::error("Job {} failed, {}", next.job.id, err.what());
+			next.client->send({ { "event", "error" }, { "id", next.job.id }, { "message", err.what() } });
+		}
+		next.client->pendingJobs--;
+	}
+}
+
+bool jobServer_t::waitForRender(batchController_t& controller, const job_t& job, client_t& client, double start, double end) {
+	auto lastProgress = std::chrono::steady_clock::now();
+	while (!controller.isDone()) {
+		auto progress = controller.update();
+		if (!running) {
+			controller.cancel();
+			client.send({ { "event", "cancelled" }, { "id", job.id } });
+			return false;
+		}
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastProgress >= PROGRESS_INTERVAL) {
+			lastProgress = now;
+			client.send({ { "event", "progress" }, { "id", job.id }, { "progress", start + progress * (end - start) } });
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return true;
+}
+
+void jobServer_t::render(const job_t& job, client_t& client) {
+	if (!job.variants.empty()) {
+		renderSweep(job, client);
+		return;
+	}
+
+	auto space = std::make_shared<space_t>();
+	space->loadFromFile(job.scene);
+	if (space->size.x == 0 || space->size.y == 0) throw std::runtime_error("Cannot render empty space");
+
+	auto& pool = threadPool_t::getShared();
+	batchController_t controller;
+	controller.setMultiplier(job.multiplier);
+	controller.setDetectorOnly(job.detectorOnly);
+	controller.setSortInterval(job.sortInterval);
+	controller.setRegion(job.region);
+	if (!job.tiled.empty()) controller.setTiledPath(job.tiled);
+	auto size = controller.getRegion(*space).size * job.resolution;
+	controller.resize((size_t)std::ceil(size.x), (size_t)std::ceil(size.y));
+	controller.startRendering(space, job.photons, job.threads == 0 ? pool.getThreadCount() : job.threads, job.seed);
+	client.send({ { "event", "started" }, { "id", job.id } });
+	if (!waitForRender(controller, job, client)) return;
+
+	if (job.detectorOnly) {
+		spdlog::info("Job {} done in {:.3f} s", job.id, controller.getStats().wallTime);
+		client.send({ { "event", "done" }, { "id", job.id }, { "stats", controller.getStats().toJson() } });
+		return;
+	}
+	pngEncoder_t::encode(controller.snapshot(), job.output, 6, pool.getThreadCount());
+	spdlog::info("Job {} done in {:.3f} s, saved {}", job.id, controller.getStats().wallTime, job.output.string());
+	client.send({ { "event", "done" }, { "id", job.id }, { "output", job.output.string() }, { "stats", controller.getStats().toJson() } });
+}
+
+void jobServer_t::renderSweep(const job_t& job, client_t& client) {
+	auto loadStart = std::chrono::steady_clock::now();
+	auto base = std::make_shared<space_t>();
+	base->loadFromFile(job.scene);
+	if (base->size.x == 0 || base->size.y == 0) throw std::runtime_error("Cannot render empty space");
+	auto loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+	for (size_t i = 0, len = job.variants.size(); i < len; i++) {
+		for (size_t j = 0, count = job.variants[i].spawners.size(); j < count; j++) {
+			if (job.variants[i].spawners[j].index >= base->spawners.size()) {
+				throw except::configValueInvalid_ex("variants[" + std::to_string(i) + "].spawners[" + std::to_string(j) + "].index", "no spawner with this index");
+			}
+		}
+	}
+
+	// Every variant patches this one copy, the workers of a variant are done with it before the next one is applied
+	auto space = std::make_shared<space_t>(*base);
+	auto& pool = threadPool_t::getShared();
+	auto threads = job.threads == 0 ? pool.getThreadCount() : job.threads;
+	batchController_t controller;
+	controller.setDetectorOnly(job.detectorOnly);
+	controller.setSortInterval(job.sortInterval);
+	controller.setRegion(job.region);
+	if (!job.tiled.empty()) controller.setTiledPath(job.tiled);
+	auto size = controller.getRegion(*base).size * job.resolution;
+	controller.resize((size_t)std::ceil(size.x), (size_t)std::ceil(size.y));
+	client.send({ { "event", "started" }, { "id", job.id }, { "variants", job.variants.size() } });
+
+	auto manifestPath = std::filesystem::path(job.output.string() + "manifest.json");
+	nlohmann::json manifest = {
+		{ "scene", job.scene.string() },
+		{ "photons", job.photons },
+		{ "resolution", job.resolution },
+		{ "loadTime", loadTime },
+		{ "variants", nlohmann::json::array() }
+	};
+	if (job.seed) manifest["seed"] = *job.seed;
+	if (job.sortInterval != 0) manifest["sort"] = job.sortInterval;
+	if (job.region) manifest["roi"] = nlohmann::json::array({ job.region->origin.x, job.region->origin.y, job.region->size.x, job.region->size.y });
+
+	for (size_t i = 0, len = job.variants.size(); i < len; i++) {
+		auto& variant = job.variants[i];
+		applyVariant(*space, *base, variant);
+		controller.setMultiplier(variant.multiplier.value_or(job.multiplier));
+		controller.clear();
+		controller.startRendering(space, job.photons, threads, job.seed);
+		if (!waitForRender(controller, job, client, (double)i / len, (double)(i + 1) / len)) return;
+
+		auto number = std::to_string(i);
+		auto output = job.detectorOnly ? std::string() : job.output.string() + std::string(number.size() < 3 ? 3 - number.size() : 0, '0') + number + ".png";
+		auto encodeStart = std::chrono::steady_clock::now();
+		if (!job.detectorOnly) pngEncoder_t::encode(controller.snapshot(), output, 6, threads);
+		auto encodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+
+		auto& stats = controller.getStats();
+		nlohmann::json entry = {
+			{ "index", i },
+			{ "parameters", variant.parameters },
+			{ "wallTime", stats.wallTime },
+			{ "photonsPerSecond", stats.wallTime > 0 ? stats.photonsSpawned / stats.wallTime : 0 },
+			{ "stats", stats.toJson() }
+		};
+		if (!job.detectorOnly) {
+			entry["output"] = output;
+			entry["encodeTime"] = encodeTime;
+		}
+		manifest["variants"].push_back(std::move(entry));
+		// Rewritten after every variant, so a cancelled sweep still describes the images it wrote
+		std::ofstream file(manifestPath);
+		if (file.fail()) throw except::fileOpenFail_ex(std::filesystem::absolute(manifestPath).string(), errno);
+		file << manifest.dump(4);
+		file.close();
+
+		nlohmann::json event = { { "event", "variant" }, { "id", job.id }, { "index", i }, { "wallTime", stats.wallTime } };
+		if (job.detectorOnly) event["detectors"] = stats.toJson()["detectors"];
+		else event["output"] = output;
+		client.send(event);
+	}
+
+	spdlog::info("Job {} done, {} variants, saved {}", job.id, job.variants.size(), manifestPath.string());
+	client.send({ { "event", "done" }, { "id", job.id }, { "output", manifestPath.string() } });
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "pch.h"
+#include "space.h"
+
+class batchController_t;
+
+/*
+	Accepts render jobs from scripts over a Unix domain socket. Every line a client sends is a json
+	job, the jobs are rendered one after another by priority on the shared thread pool, while the
+	progress of each job is streamed back to its client as json lines.
+*/
+class jobServer_t {
+public:
+	/* One render of a sweep, the values not given are the ones of the job and the scene */
+	struct variant_t {
+		struct spawnerPatch_t {
+			size_t index = 0;
+			std::optional<color_t> color;
+			/* Relative to the ratios of the scene, which add up to one after loading */
+			std::optional<extent_t> ratio;
+			std::optional<extent_t> spread;
+			std::optional<vec2_t> direction;
+		};
+
+		std::optional<extent_t> multiplier;
+		/* Replaces the roughness of every shape */
+		std::optional<extent_t> roughness;
+		std::vector<spawnerPatch_t> spawners;
+		/* The variant as it was sent, copied to the manifest */
+		nlohmann::json parameters;
+	};
+
+	struct job_t {
+		size_t id = 0;
+		std::filesystem::path scene;
+		size_t photons = 0;
+		/* Pixels per room unit */
+		double resolution = 10;
+		/* Only this part of the room is drawn, the image has the size of the region times the resolution */
+		std::optional<region_t> region;
+		/* When not empty the image is accumulated in a tiled image in this file, for images bigger than the memory */
+		std::filesystem::path tiled;
+		std::filesystem::path output;
+		/* Jobs with a higher priority run first, jobs with the same priority in the order they came */
+		int priority = 0;
+		/* Zero means one worker for every thread of the pool */
+		size_t threads = 0;
+		extent_t multiplier = 0.01;
+		std::optional<std::mt19937::result_type> seed;
+		/* The workers sort their photons by position every this many steps, zero to not sort them */
+		size_t sortInterval = 0;
+		/* Only the detectors measure the photons, no image is drawn or saved and the output is only needed by sweeps */
+		bool detectorOnly = false;
+		/*
+			When not empty the job is a sweep, the scene is loaded once and rendered for every variant.
+			The output is then a prefix, the images are saved as <output>000.png and so on and the
+			parameters and timings of every variant as <output>manifest.json
+		*/
+		std::vector<variant_t> variants;
+	};
+
+protected:
+	struct client_t;
+
+	struct queued_t {
+		job_t job;
+		std::shared_ptr<client_t> client;
+
+		inline bool operator<(const queued_t& other) const {
+			if (job.priority != other.job.priority) return job.priority < other.job.priority;
+			return job.id > other.job.id;
+		}
+	};
+
+	std::filesystem::path socketPath;
+	/* The platform socket handle, -1 when not listening */
+	std::intptr_t listenSocket = -1;
+	std::thread listenThread;
+	std::thread runThread;
+	std::atomic<bool> running = false;
+
+	std::mutex queueMutex;
+	std::condition_variable queueChanged;
+	std::priority_queue<queued_t> queue;
+	size_t lastId = 0;
+
+	/* Accepts the clients and reads their jobs, on the listen thread */
+	void listen();
+	/* Renders the queued jobs, on the run thread */
+	void run();
+	void render(const job_t& job, client_t& client);
+	void renderSweep(const job_t& job, client_t& client);
+	/* Sends the progress of the render until it finishes, progress is scaled into the range from start to end. Returns false if the server was stopped, the render is then cancelled */
+	bool waitForRender(batchController_t& controller, const job_t& job, client_t& client, double start = 0, double end = 1);
+	/* Parses the line and queues the job, the client is told the id or the error */
+	void enqueue(const std::string& line, const std::shared_ptr<client_t>& client);
+
+public:
+	/* Throws except::config_ex if a value of the job is missing or invalid */
+	static job_t parseJob(const nlohmann::json& json);
+
+	/* Starts listening on the path, an old socket file on it is replaced. Throws std::runtime_error if the socket cannot be created */
+	void start(const std::filesystem::path& path);
+	/* Stops listening, the running job is cancelled and the queued ones are dropped */
+	void stop();
+
+	inline bool isRunning() const { return running; }
+	inline const std::filesystem::path& getPath() const { return socketPath; }
+	size_t getQueueLength();
+
+	jobServer_t() = default;
+	jobServer_t(const jobServer_t&) = delete;
+	jobServer_t& operator=(const jobServer_t&) = delete;
+
+	inline ~jobServer_t() {
+		stop();
+	}
+};
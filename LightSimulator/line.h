@@ -2,19 +2,22 @@
 #include "vectors.h"
 #include "shape.h"
 
+/* Squared distance from the point to the segment from a to b, in the precision of the points */
+template <typename T>
+inline T getSegmentDistSquared(const basicVec2_t<T>& p, const basicVec2_t<T>& a, const basicVec2_t<T>& b) {
+	// Source https://iquilezles.org/www/articles/distfunctions/distfunctions.htm
+	auto pa = p - a, ba = b - a;
+	T h = std::clamp(dot(pa, ba) / dot(ba, ba), (T)0, (T)1);
+	auto offset = pa - ba * h;
+	return dot(offset, offset);
+}
+
 struct line_t : public shape_t {
 	vec2_t a;
 	vec2_t b;
 
 	inline extent_t getDist(const vec2_t& p) const override {
-		// Source https://iquilezles.org/www/articles/distfunctions/distfunctions.htm
-		vec2_t pa = p - a, ba = b - a;
-		extent_t h = (dot(pa, ba) / dot(ba, ba));
-
-		if (h < 0) h = 0;
-		if (h > 1) h = 1;
-
-		return (pa - ba * h).length();
+		return std::sqrt(getSegmentDistSquared(p, a, b));
 	}
 
 	inline vec2_t getNormal(const vec2_t& point) const override {
@@ -8,9 +8,7 @@ int main() try {
 	sdlhelp::handleSDLError(IMG_Init(IMG_INIT_PNG));
 	spdlog::info("SDL initialized");
 
-	space_t space;
-
-	update(space);
+	update(std::make_shared<const space_t>());
 
 	return 0;
 } catch (const std::exception & err) {
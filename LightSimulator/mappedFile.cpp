@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "mappedFile.h"
+#include "exceptions.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef _WIN32
+void mappedFile_t::open(const std::filesystem::path& path) {
+	close();
+	auto fail = [&]() {
+		auto error = GetLastError();
+		close();
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), except::getWin32ErrStr(error));
+	};
+
+	fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		fileHandle = nullptr;
+		fail();
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) fail();
+	size = (size_t)fileSize.QuadPart;
+	// Empty files cannot be mapped, they are left with no data
+	if (size == 0) return;
+
+	mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) fail();
+
+	data = (Uint8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) fail();
+}
+
+void mappedFile_t::create(const std::filesystem::path& path, size_t size) {
+	close();
+	auto fail = [&]() {
+		auto error = GetLastError();
+		close();
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), except::getWin32ErrStr(error));
+	};
+
+	fileHandle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		fileHandle = nullptr;
+		fail();
+	}
+	this->size = size;
+	if (size == 0) return;
+
+	// The mapping extends the file to its size, the new part reads as zeroes
+	LARGE_INTEGER mappingSize;
+	mappingSize.QuadPart = (LONGLONG)size;
+	mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READWRITE, (DWORD)mappingSize.HighPart, mappingSize.LowPart, nullptr);
+	if (!mappingHandle) fail();
+
+	data = (Uint8*)MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!data) fail();
+}
+
+void mappedFile_t::close() {
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+	data = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	size = 0;
+}
+#else
+void mappedFile_t::open(const std::filesystem::path& path) {
+	close();
+	auto fail = [&]() {
+		auto error = errno;
+		close();
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), error);
+	};
+
+	fileDescriptor = ::open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) fail();
+
+	struct stat info;
+	if (fstat(fileDescriptor, &info) != 0) fail();
+	size = (size_t)info.st_size;
+	// Empty files cannot be mapped, they are left with no data
+	if (size == 0) return;
+
+	auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED) fail();
+	data = (Uint8*)mapping;
+	madvise(mapping, size, MADV_SEQUENTIAL);
+}
+
+void mappedFile_t::create(const std::filesystem::path& path, size_t size) {
+	close();
+	auto fail = [&]() {
+		auto error = errno;
+		close();
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), error);
+	};
+
+	fileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fileDescriptor < 0) fail();
+	// The file is sparse, pages that were never written take no disk space and read as zeroes
+	if (ftruncate(fileDescriptor, (off_t)size) != 0) fail();
+	this->size = size;
+	if (size == 0) return;
+
+	auto mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+	if (mapping == MAP_FAILED) fail();
+	data = (Uint8*)mapping;
+	madvise(mapping, size, MADV_RANDOM);
+}
+
+void mappedFile_t::close() {
+	if (data) munmap((void*)data, size);
+	if (fileDescriptor >= 0) ::close(fileDescriptor);
+	data = nullptr;
+	fileDescriptor = -1;
+	size = 0;
+}
+#endif // _WIN32
@@ -0,0 +1,36 @@
+#pragma once
+#include "pch.h"
+
+/* Memory mapping of a whole file, the mapping is released on destruction */
+class mappedFile_t {
+protected:
+	Uint8* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif // _WIN32
+
+public:
+	/* Releases the mapping and the file, also done on destruction */
+	void close();
+	/* Throws except::fileOpenFail_ex if the file cannot be opened or mapped */
+	void open(const std::filesystem::path& path);
+	/* Replaces the file with one of the size filled with zeroes and maps it for writing. Throws except::fileOpenFail_ex if it cannot be created or mapped */
+	void create(const std::filesystem::path& path, size_t size);
+
+	inline const Uint8* getData() const { return data; }
+	/* Only valid for files opened by create() */
+	inline Uint8* getWritableData() { return data; }
+	inline size_t getSize() const { return size; }
+
+	mappedFile_t() = default;
+	mappedFile_t(const mappedFile_t&) = delete;
+	mappedFile_t& operator=(const mappedFile_t&) = delete;
+
+	inline ~mappedFile_t() {
+		close();
+	}
+};
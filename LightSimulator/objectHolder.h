@@ -0,0 +1,50 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+
+/* Shapes with a bounding volume are skipped when it is further than the closest shape found so far */
+template <typename T>
+concept boundedShape = requires(const T& shape, const vec2_t& point) {
+	shape.getBoundDist(point);
+};
+
+template <typename T>
+struct objectHolder_t {
+	std::vector<T> items;
+
+	extent_t getMinDist(const vec2_t& point) const {
+		extent_t min = std::numeric_limits<extent_t>::infinity();
+		for (size_t i = 0, len = items.size(); i < len; i++) {
+			if constexpr (boundedShape<T>) {
+				if (items[i].getBoundDist(point) >= min) continue;
+			}
+			extent_t dist = items[i].getDist(point);
+			if (dist < min) {
+				min = dist;
+			}
+		}
+		return min;
+	}
+
+	/* If evaluations is not null, the amount of distance functions evaluated is added to it */
+	std::pair<const T*, extent_t> getClosest(const vec2_t& point, size_t* evaluations = nullptr) const {
+		extent_t min = std::numeric_limits<extent_t>::infinity();
+		const T* target = nullptr;
+		size_t evaluated = 0;
+		for (size_t i = 0, len = items.size(); i < len; i++) {
+			if constexpr (boundedShape<T>) {
+				if (items[i].getBoundDist(point) >= min) continue;
+			}
+			evaluated++;
+			extent_t dist = items[i].getDist(point);
+			if (dist < min) {
+				min = dist;
+				target = &items[i];
+			}
+		}
+		if (evaluations) *evaluations += evaluated;
+		return { target, min };
+	}
+
+	objectHolder_t() : items() {}
+};
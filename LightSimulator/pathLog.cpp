@@ -0,0 +1,247 @@
+#include "pch.h"
+#include "pathLog.h"
+#include "rendering.h"
+#include "exceptions.h"
+
+namespace {
+	constexpr char MAGIC[4] = { 'L', 'S', 'P', '1' };
+	constexpr uint32_t VERSION = 1;
+	/* Chunks are written when a worker has this many bytes of records */
+	constexpr size_t CHUNK_SIZE = 1 << 20;
+	/* Photons dimmer than this are killed by the workers, replayed paths end there too */
+	constexpr extent_t MIN_INTENSITY = 0.004;
+	/*
+		The replay threads add to the targets under the lock of a stripe of rows, there are this many
+		stripes per thread. Long lines cross many stripes and every stripe crossed is a lock taken, so
+		there are only as many as needed for the threads to rarely wait
+	*/
+	constexpr size_t STRIPES_PER_THREAD = 4;
+
+	struct header_t {
+		char magic[4];
+		uint32_t version;
+		double size[2];
+		/* The amount of shapes and spawners of the room, the paths refer to them by index */
+		uint64_t shapeCount;
+		uint64_t spawnerCount;
+	};
+
+	/* Followed by the compressed records. A record is the spawner index and the vertex count as uint32 and then the vertices */
+	struct chunkHeader_t {
+		uint32_t rawSize;
+		uint32_t compressedSize;
+		uint32_t photons;
+	};
+
+	struct recordHeader_t {
+		uint32_t spawner;
+		uint32_t vertexCount;
+	};
+
+	/* Reads the chunks of the file one at a time, shared by the replay tasks */
+	struct chunkReader_t {
+		std::ifstream file;
+		std::mutex mutex;
+
+		/* Returns false at the end of the file. A chunk that was not written completely yet counts as the end */
+		bool next(chunkHeader_t& header, std::vector<Uint8>& compressed) {
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!file.read((char*)&header, sizeof(header))) return false;
+			compressed.resize(header.compressedSize);
+			return (bool)file.read((char*)compressed.data(), compressed.size());
+		}
+	};
+
+	/* The targets as one replay thread draws into them, a pixel is added under the lock of its stripe of rows */
+	class stripedTarget_t {
+	protected:
+		std::vector<std::vector<color_t>>& targets;
+		std::vector<std::mutex>& locks;
+		size_t width;
+		size_t stripeRows;
+		/* The lock of the rows from lockedStart to lockedEnd. A path is drawn line after line and a line row after row, so it changes only between stripes */
+		std::unique_lock<std::mutex> lock;
+		size_t lockedStart = 0;
+		size_t lockedEnd = 0;
+
+	public:
+		inline void add(color_t* target, int x, int y, const color_t& color) {
+			if ((size_t)y < lockedStart || (size_t)y >= lockedEnd) {
+				if (lock.owns_lock()) lock.unlock();
+				auto stripe = (size_t)y / stripeRows;
+				lock = std::unique_lock<std::mutex>(locks[stripe]);
+				lockedStart = stripe * stripeRows;
+				lockedEnd = lockedStart + stripeRows;
+			}
+			auto& pixel = target[x + (size_t)y * width];
+			pixel = pixel + color;
+		}
+
+		inline color_t* getTarget(size_t index) {
+			return targets[index].data();
+		}
+
+		/* Releases the lock, called after every chunk. Only one lock is held at a time, so threads never wait for each other in a cycle */
+		inline void release() {
+			if (lock.owns_lock()) lock.unlock();
+			lockedStart = lockedEnd = 0;
+		}
+
+		/* There is a lock for every stripe of stripeRows rows */
+		stripedTarget_t(std::vector<std::vector<color_t>>& targets, std::vector<std::mutex>& locks, size_t width, size_t stripeRows) : targets(targets), locks(locks), width(width), stripeRows(stripeRows) {}
+	};
+
+	void drawChunk(const std::vector<Uint8>& raw, const space_t& space, const std::vector<color_t>& reflectivities, stripedTarget_t& image, size_t width, size_t height, const region_t& region, bool layered, pathReplay_t& replay) {
+		auto corrupted = []() { return except::config_ex("The path log is corrupted"); };
+		auto data = raw.data();
+		auto end = raw.data() + raw.size();
+		while (data < end) {
+			if ((size_t)(end - data) < sizeof(recordHeader_t)) throw corrupted();
+			recordHeader_t record;
+			std::memcpy(&record, data, sizeof(record));
+			data += sizeof(record);
+			if (record.spawner >= space.spawners.size() || (size_t)(end - data) / sizeof(pathVertex_t) < record.vertexCount) throw corrupted();
+
+			auto target = image.getTarget(layered ? space.spawnerLayers[record.spawner] : 0);
+			auto color = layered ? color_t(1, 1, 1) : space.spawners[record.spawner].color;
+			pathVertex_t from;
+			pathVertex_t to;
+			for (size_t i = 0; i < record.vertexCount; i++, data += sizeof(pathVertex_t)) {
+				std::memcpy(&to, data, sizeof(to));
+				if (i != 0) {
+					walkLine(width, height, region, vec2_t(from.x, from.y), vec2_t(to.x, to.y), [&](int x, int y) {
+						image.add(target, x, y, color);
+					});
+				}
+				if (to.surface != pathVertex_t::NO_SURFACE) {
+					if (to.surface >= reflectivities.size()) throw corrupted();
+					color = color * reflectivities[to.surface];
+				}
+				from = to;
+				// The rest of the path was drawn too dim to see by the worker, or the new reflectivity makes it so
+				if (color.getIntensity() < MIN_INTENSITY) {
+					data += sizeof(pathVertex_t) * (record.vertexCount - i);
+					break;
+				}
+			}
+			replay.photons++;
+			replay.vertices += record.vertexCount;
+		}
+		image.release();
+	}
+}
+
+pathWriter_t::pathWriter_t(const std::filesystem::path& path, const space_t& space) : path(path) {
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	header_t header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.size[0] = space.size.x;
+	header.size[1] = space.size.y;
+	header.shapeCount = space.getShapeCount();
+	header.spawnerCount = space.spawners.size();
+	file.write((const char*)&header, sizeof(header));
+}
+
+void pathWriter_t::write(const std::vector<Uint8>& records, size_t photons) {
+	if (photons == 0) return;
+	// Level 1, the paths compress well enough and the workers should not wait for the compression
+	auto compressedSize = compressBound((uLong)records.size());
+	std::vector<Uint8> compressed(compressedSize);
+	if (compress2(compressed.data(), &compressedSize, records.data(), (uLong)records.size(), 1) != Z_OK) {
+		throw std::runtime_error("Failed to compress paths");
+	}
+
+	chunkHeader_t header = { (uint32_t)records.size(), (uint32_t)compressedSize, (uint32_t)photons };
+	std::unique_lock<std::mutex> lock(mutex);
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)compressed.data(), compressedSize);
+	if (file.fail()) throw std::runtime_error("Failed to write file " + std::filesystem::absolute(path).string());
+}
+
+void pathWriter_t::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	file.flush();
+}
+
+void pathRecorder_t::add(uint32_t spawner, const std::vector<pathVertex_t>& vertices) {
+	recordHeader_t record = { spawner, (uint32_t)vertices.size() };
+	auto offset = records.size();
+	records.resize(offset + sizeof(record) + vertices.size() * sizeof(pathVertex_t));
+	std::memcpy(records.data() + offset, &record, sizeof(record));
+	std::memcpy(records.data() + offset + sizeof(record), vertices.data(), vertices.size() * sizeof(pathVertex_t));
+	photons++;
+	if (records.size() >= CHUNK_SIZE) flush();
+}
+
+void pathRecorder_t::flush() {
+	writer->write(records, photons);
+	records.clear();
+	photons = 0;
+}
+
+pathReplay_t replayPaths(const std::filesystem::path& path, const space_t& space, std::vector<std::vector<color_t>>& targets, size_t width, size_t height, const region_t& region, bool layered, const std::atomic<bool>* cancelled) {
+	auto start = std::chrono::steady_clock::now();
+	chunkReader_t reader;
+	reader.file.open(path, std::ios::binary);
+	if (reader.file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	header_t header = {};
+	reader.file.read((char*)&header, sizeof(header));
+	if (!reader.file || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+		throw except::config_ex("File " + path.string() + " is not a path log");
+	}
+	if (header.size[0] != space.size.x || header.size[1] != space.size.y || header.shapeCount != space.getShapeCount() || header.spawnerCount != space.spawners.size()) {
+		throw except::config_ex("The paths in " + path.string() + " were recorded in another room");
+	}
+
+	// Only the reflectivities can differ from the recorded room, they are looked up by the shape index
+	std::vector<color_t> reflectivities(space.getShapeCount());
+	for (size_t i = 0, len = reflectivities.size(); i < len; i++) {
+		reflectivities[i] = space.getShape(i).reflectivity;
+	}
+
+	targets.resize(layered ? space.layerNames.size() : 1);
+	for (auto& target : targets) target.assign(width * height, color_t());
+
+	/// Drawing the chunks on threads of their own, so the replay does not queue behind the renders on the pool. All threads draw into the targets, a stripe of rows at a time
+	auto taskCount = std::max((size_t)std::thread::hardware_concurrency(), (size_t)1);
+	auto stripeCount = taskCount * STRIPES_PER_THREAD;
+	auto stripeRows = std::max((height + stripeCount - 1) / stripeCount, (size_t)1);
+	std::vector<std::mutex> locks(stripeCount);
+	std::vector<pathReplay_t> taskReplays(taskCount);
+	std::vector<std::future<void>> tasks;
+	for (size_t i = 0; i < taskCount; i++) {
+		tasks.push_back(std::async(std::launch::async, [&, i]() {
+			stripedTarget_t image(targets, locks, width, stripeRows);
+			chunkHeader_t chunk;
+			std::vector<Uint8> compressed;
+			std::vector<Uint8> raw;
+			while (!(cancelled && *cancelled) && reader.next(chunk, compressed)) {
+				raw.resize(chunk.rawSize);
+				uLongf rawSize = chunk.rawSize;
+				if (uncompress(raw.data(), &rawSize, compressed.data(), (uLong)compressed.size()) != Z_OK || rawSize != chunk.rawSize) {
+					throw except::config_ex("The path log is corrupted");
+				}
+				drawChunk(raw, space, reflectivities, image, width, height, region, layered, taskReplays[i]);
+			}
+		}));
+	}
+	// All tasks are waited for before any exception is rethrown, they refer to the locals
+	for (auto& task : tasks) task.wait();
+	for (auto& task : tasks) task.get();
+
+	pathReplay_t replay;
+	for (auto& taskReplay : taskReplays) {
+		replay.photons += taskReplay.photons;
+		replay.vertices += taskReplay.vertices;
+	}
+	replay.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return replay;
+}
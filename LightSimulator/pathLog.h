@@ -0,0 +1,76 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+#include "space.h"
+
+/*
+	Path log (.lsp), the paths of all photons of a render, so the image can be drawn again at
+	another resolution or with other reflectivities without simulating anything. The file is a
+	header followed by independently compressed chunks, each written by one worker as soon as it
+	finished enough photons, so the file can be read while it is still being written. A photon is
+	stored as the index of its spawner and the chain of points it moved through, with the shape it
+	bounced off at every point. The colour is not stored, it is made from the space when replaying.
+*/
+
+/* A point of the path of a photon, in space coordinates */
+struct pathVertex_t {
+	float x;
+	float y;
+	/* The index of the shape the photon bounced off here, see space_t::getShapeIndex(), or NO_SURFACE */
+	uint32_t surface;
+
+	static constexpr uint32_t NO_SURFACE = 0xFFFFFFFF;
+};
+
+/* Writes the chunks of the workers into one file */
+class pathWriter_t {
+protected:
+	std::ofstream file;
+	std::mutex mutex;
+	std::filesystem::path path;
+
+public:
+	/* Compresses the records of the photons on the calling thread and appends them as a chunk */
+	void write(const std::vector<Uint8>& records, size_t photons);
+	/* Makes the written chunks visible to readers of the file */
+	void flush();
+
+	inline const std::filesystem::path& getPath() const { return path; }
+
+	/* Replaces the file. Throws except::fileOpenFail_ex if it cannot be opened */
+	pathWriter_t(const std::filesystem::path& path, const space_t& space);
+	pathWriter_t(const pathWriter_t&) = delete;
+	pathWriter_t& operator=(const pathWriter_t&) = delete;
+};
+
+/* Collects the finished paths of one worker and writes them in chunks */
+class pathRecorder_t {
+protected:
+	std::shared_ptr<pathWriter_t> writer;
+	std::vector<Uint8> records;
+	size_t photons = 0;
+
+public:
+	void add(uint32_t spawner, const std::vector<pathVertex_t>& vertices);
+	/* Writes the paths added since the last chunk */
+	void flush();
+
+	inline pathRecorder_t(std::shared_ptr<pathWriter_t> writer) : writer(std::move(writer)) {}
+};
+
+struct pathReplay_t {
+	size_t photons = 0;
+	size_t vertices = 0;
+	/* Seconds */
+	double time = 0;
+};
+
+/*
+	Draws the paths of the file into the targets of the size showing the region, which are overwritten. When layered
+	the targets are the layers of the space drawn with unit colour, otherwise a single target drawn
+	with the spawner colours. The chunks are decompressed and drawn in parallel on threads of the
+	replay, not on the pool. Once cancelled is set no more chunks are drawn.
+	Throws except::fileOpenFail_ex if the file cannot be opened and except::config_ex if it is not
+	a path log or it was recorded in a room with other shapes or spawners
+*/
+pathReplay_t replayPaths(const std::filesystem::path& path, const space_t& space, std::vector<std::vector<color_t>>& targets, size_t width, size_t height, const region_t& region, bool layered, const std::atomic<bool>* cancelled = nullptr);
@@ -23,6 +23,7 @@
 #include <SDL2/SDL_image.h>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
+#include <zlib.h>
 #pragma warning( pop )
 #include <unordered_map>
 #include <stdexcept>
@@ -35,6 +36,12 @@
 #include <deque>
 #include <chrono>
 #include <random>
+#include <optional>
+#include <future>
+#include <condition_variable>
+#include <queue>
+#include <bitset>
+#include <charconv>
 
 #include "lib/SDLHelper.h"
 #include "lib/surfaceShapes/surfaceShapes.h"
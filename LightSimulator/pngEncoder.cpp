@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "pngEncoder.h"
+#include "exceptions.h"
+
+namespace {
+	/* Bytes per pixel, the encoder always writes 8-bit RGB */
+	constexpr size_t BPP = 3;
+	constexpr size_t CHUNK_SIZE = 1 << 16;
+
+	struct band_t {
+		std::vector<Uint8> data;
+		uLong adler = 1;
+		uLong length = 0;
+	};
+
+	inline Uint8 paeth(int a, int b, int c) {
+		int p = a + b - c;
+		int pa = std::abs(p - a);
+		int pb = std::abs(p - b);
+		int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) return (Uint8)a;
+		if (pb <= pc) return (Uint8)b;
+		return (Uint8)c;
+	}
+
+	/* Writes the row filtered with the filter type into target, target[0] is the filter type byte. Returns the sum of absolute values used to pick the best filter */
+	size_t filterRow(int type, const Uint8* row, const Uint8* prev, size_t rowSize, Uint8* target) {
+		size_t sum = 0;
+		target[0] = (Uint8)type;
+		for (size_t i = 0; i < rowSize; i++) {
+			int left = i >= BPP ? row[i - BPP] : 0;
+			int up = prev[i];
+			int upLeft = i >= BPP ? prev[i - BPP] : 0;
+			Uint8 value = row[i];
+			switch (type) {
+			case 1: value -= (Uint8)left; break;
+			case 2: value -= (Uint8)up; break;
+			case 3: value -= (Uint8)((left + up) / 2); break;
+			case 4: value -= paeth(left, up, upLeft); break;
+			}
+			target[i + 1] = value;
+			sum += (size_t)std::abs((int)(Sint8)value);
+		}
+		return sum;
+	}
+
+	/* Filters and deflates rows [start, end) into a raw deflate stream. Bands other than the last are ended with a sync flush so they can be concatenated */
+	void compressBand(const imageSource_t& image, size_t start, size_t end, bool last, int level, band_t& band) {
+		size_t rowSize = image.width * BPP;
+		std::vector<Uint8> prev(rowSize, 0), row(rowSize);
+		std::vector<Uint8> filtered[5];
+		for (auto& candidate : filtered) candidate.resize(rowSize + 1);
+		// The first row of a band is filtered against the last row of the previous band, so the result is the same as a serial encode
+		if (start > 0) image.fillRow(start - 1, prev.data());
+
+		z_stream stream = {};
+		if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error("Failed to initialize deflate stream");
+		}
+
+		Uint8 out[CHUNK_SIZE];
+		for (size_t y = start; y < end; y++) {
+			image.fillRow(y, row.data());
+
+			// Heuristic from the PNG spec, choose the filter with the smallest sum of absolute differences. Stored images are not filtered at all
+			size_t best = 0;
+			if (level == 0) {
+				filterRow(0, row.data(), prev.data(), rowSize, filtered[0].data());
+			} else {
+				size_t bestSum = std::numeric_limits<size_t>::max();
+				for (int type = 0; type < 5; type++) {
+					auto sum = filterRow(type, row.data(), prev.data(), rowSize, filtered[type].data());
+					if (sum < bestSum) {
+						bestSum = sum;
+						best = type;
+					}
+				}
+			}
+
+			auto& data = filtered[best];
+			band.adler = adler32(band.adler, data.data(), (uInt)data.size());
+			band.length += (uLong)data.size();
+
+			int flush = y + 1 < end ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+			stream.next_in = data.data();
+			stream.avail_in = (uInt)data.size();
+			do {
+				stream.next_out = out;
+				stream.avail_out = CHUNK_SIZE;
+				deflate(&stream, flush);
+				band.data.insert(band.data.end(), out, out + (CHUNK_SIZE - stream.avail_out));
+			} while (stream.avail_out == 0);
+
+			std::swap(prev, row);
+		}
+
+		deflateEnd(&stream);
+	}
+
+	void writeUint32(std::ostream& file, uLong value) {
+		Uint8 bytes[] = { (Uint8)(value >> 24), (Uint8)(value >> 16), (Uint8)(value >> 8), (Uint8)value };
+		file.write((const char*)bytes, 4);
+	}
+
+	void writeChunk(std::ostream& file, const char type[5], const Uint8* data, size_t size) {
+		writeUint32(file, (uLong)size);
+		file.write(type, 4);
+		if (size > 0) file.write((const char*)data, size);
+		auto crc = crc32(0, (const Bytef*)type, 4);
+		if (size > 0) crc = crc32(crc, data, (uInt)size);
+		writeUint32(file, crc);
+	}
+}
+
+void pngEncoder_t::encode(const imageSource_t& image, const std::filesystem::path& path, int compressionLevel, size_t bandCount) {
+	if (image.width == 0 || image.height == 0) throw std::runtime_error("Cannot encode an empty image");
+	if (bandCount == 0) bandCount = 1;
+	if (bandCount > image.height) bandCount = image.height;
+
+	/// Compressing the bands
+	std::vector<band_t> bands(bandCount);
+	std::vector<std::exception_ptr> errors(bandCount);
+	{
+		auto rowsForOne = (image.height + bandCount - 1) / bandCount;
+		std::vector<std::thread> threads;
+		threads.reserve(bandCount);
+		for (size_t i = 0; i < bandCount; i++) {
+			auto start = i * rowsForOne;
+			auto end = std::min(start + rowsForOne, image.height);
+			threads.emplace_back([&, i, start, end]() {
+				try {
+					compressBand(image, start, end, i + 1 == bandCount, compressionLevel, bands[i]);
+				} catch (...) {
+					errors[i] = std::current_exception();
+				}
+			});
+		}
+		for (auto& thread : threads) thread.join();
+		for (auto& error : errors) {
+			if (error) std::rethrow_exception(error);
+		}
+	}
+
+	/// Writing the file
+	std::ofstream file;
+	file.open(path, std::ios::binary);
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	constexpr Uint8 SIGNATURE[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	file.write((const char*)SIGNATURE, sizeof(SIGNATURE));
+
+	{
+		Uint8 header[13] = {};
+		for (int i = 0; i < 4; i++) {
+			header[i] = (Uint8)(image.width >> (24 - i * 8));
+			header[4 + i] = (Uint8)(image.height >> (24 - i * 8));
+		}
+		// Bit depth 8, color type RGB, default compression, filter and interlace methods
+		header[8] = 8;
+		header[9] = 2;
+		writeChunk(file, "IHDR", header, sizeof(header));
+	}
+
+	{
+		// The zlib header, the level hint is only informative
+		Uint8 level = compressionLevel < 2 ? 0 : compressionLevel < 6 ? 1 : compressionLevel == 6 ? 2 : 3;
+		Uint8 zlibHeader[2] = { 0x78, (Uint8)(level << 6) };
+		zlibHeader[1] += (Uint8)(31 - ((zlibHeader[0] * 256 + zlibHeader[1]) % 31));
+		writeChunk(file, "IDAT", zlibHeader, sizeof(zlibHeader));
+	}
+
+	// The raw deflate streams of the bands concatenate into one, their checksums are combined
+	uLong adler = adler32(0, nullptr, 0);
+	for (auto& band : bands) {
+		writeChunk(file, "IDAT", band.data.data(), band.data.size());
+		adler = adler32_combine(adler, band.adler, band.length);
+	}
+
+	{
+		Uint8 trailer[4] = { (Uint8)(adler >> 24), (Uint8)(adler >> 16), (Uint8)(adler >> 8), (Uint8)adler };
+		writeChunk(file, "IDAT", trailer, sizeof(trailer));
+	}
+
+	writeChunk(file, "IEND", nullptr, 0);
+
+	if (file.fail()) throw std::runtime_error("Failed to write file " + std::filesystem::absolute(path).string());
+}
+
+void pngEncoder_t::save(imageSource_t&& image, const std::filesystem::path& path) {
+	auto& job = jobs.emplace_back(std::make_unique<job_t>());
+	job->path = path;
+
+	size_t bandCount = std::thread::hardware_concurrency();
+	if (bandCount == 0) bandCount = 4;
+
+	job->thread = std::thread([job = job.get(), image = std::move(image), level = compressionLevel, bandCount]() {
+		auto start = std::chrono::high_resolution_clock::now();
+		try {
+			encode(image, job->path, level, bandCount);
+			auto end = std::chrono::high_resolution_clock::now();
+			spdlog::info("File saved {} ({} ms)", job->path.string(), std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
+		} catch (const std::exception & err) {
+			spdlog::error(err.what());
+		}
+		job->done = true;
+	});
+}
+
+size_t pngEncoder_t::update() {
+	auto iter = std::remove_if(jobs.begin(), jobs.end(), [](std::unique_ptr<job_t>& job) {
+		if (job->done) {
+			job->thread.join();
+			return true;
+		} else return false;
+	});
+
+	if (iter != jobs.end()) jobs.erase(iter, jobs.end());
+	return jobs.size();
+}
+
+void pngEncoder_t::waitAll() {
+	for (auto& job : jobs) {
+		if (job->thread.joinable()) job->thread.join();
+	}
+	jobs.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "pch.h"
+
+/* Source of the pixel data for an encode. fillRow must write width * 3 bytes of RGB and be safe to call from multiple threads at once */
+struct imageSource_t {
+	size_t width = 0;
+	size_t height = 0;
+	std::function<void(size_t y, Uint8* row)> fillRow;
+};
+
+/*
+	Writes PNG files on background threads. Every save gets its own thread, which splits
+	the image into row bands and deflates each band on a separate thread as an independent
+	stream, so saves of big images neither block the caller nor wait for each other.
+*/
+class pngEncoder_t {
+protected:
+	struct job_t {
+		std::filesystem::path path;
+		std::thread thread;
+		std::atomic<bool> done = false;
+	};
+
+	std::vector<std::unique_ptr<job_t>> jobs;
+	int compressionLevel = 6;
+
+public:
+	/* Starts encoding the image, the image source is moved to the encoding thread */
+	void save(imageSource_t&& image, const std::filesystem::path& path);
+	/* Joins the finished encodes, returns the number of encodes still running */
+	size_t update();
+	/* Blocks until all encodes are written */
+	void waitAll();
+
+	inline void setCompressionLevel(int value) {
+		compressionLevel = value;
+	}
+	inline int getCompressionLevel() const { return compressionLevel; }
+
+	/* Encodes the image synchronously, using bandCount threads. Throws std::runtime_error on failure */
+	static void encode(const imageSource_t& image, const std::filesystem::path& path, int compressionLevel, size_t bandCount);
+
+	inline ~pngEncoder_t() {
+		waitAll();
+	}
+};
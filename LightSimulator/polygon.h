@@ -0,0 +1,92 @@
+#pragma once
+#include "vectors.h"
+#include "shape.h"
+#include "line.h"
+
+/*
+	Chain of lines sharing their vertices. A closed polygon also connects the last vertex
+	to the first and is solid, points inside it are inside the obstacle. Every edge is
+	a separate part. Call update() after changing the vertices
+*/
+struct polygon_t : public shape_t {
+	std::vector<vec2_t> vertices;
+	bool closed = true;
+	// Bounding box, derived from the vertices by update()
+	vec2_t min;
+	vec2_t max;
+
+	inline void update() {
+		min = vec2_t(std::numeric_limits<extent_t>::infinity(), std::numeric_limits<extent_t>::infinity());
+		max = -min;
+		for (auto& vertex : vertices) {
+			min = vec2_t(std::min(min.x, vertex.x), std::min(min.y, vertex.y));
+			max = vec2_t(std::max(max.x, vertex.x), std::max(max.y, vertex.y));
+		}
+	}
+
+	inline size_t getEdgeCount() const {
+		if (vertices.size() < 2) return 0;
+		return closed ? vertices.size() : vertices.size() - 1;
+	}
+
+	inline std::pair<const vec2_t&, const vec2_t&> getEdge(size_t index) const {
+		return { vertices[index], vertices[index + 1 == vertices.size() ? 0 : index + 1] };
+	}
+
+	/* Distance to the bounding box, never bigger than the distance to the polygon */
+	inline extent_t getBoundDist(const vec2_t& p) const {
+		extent_t dx = std::max({ min.x - p.x, 0.0, p.x - max.x });
+		extent_t dy = std::max({ min.y - p.y, 0.0, p.y - max.y });
+		return std::sqrt(dx * dx + dy * dy);
+	}
+
+	/* Returns the squared distance to the closest edge and its index */
+	inline std::pair<extent_t, size_t> getClosestEdge(const vec2_t& p) const {
+		extent_t min = std::numeric_limits<extent_t>::infinity();
+		size_t closest = 0;
+		for (size_t i = 0, len = getEdgeCount(); i < len; i++) {
+			auto [a, b] = getEdge(i);
+			extent_t dist = getSegmentDistSquared(p, a, b);
+			if (dist < min) {
+				min = dist;
+				closest = i;
+			}
+		}
+		return { min, closest };
+	}
+
+	inline extent_t getDist(const vec2_t& p) const override {
+		return std::sqrt(getClosestEdge(p).first);
+	}
+
+	inline vec2_t getNormal(const vec2_t& point) const override {
+		auto [a, b] = getEdge(getClosestEdge(point).second);
+		return (b - a).perpendicular().normalize();
+	}
+
+	inline size_t getPart(const vec2_t& point) const override {
+		return getClosestEdge(point).second;
+	}
+
+	inline std::pair<vec2_t, size_t> getSurface(const vec2_t& point) const override {
+		auto edge = getClosestEdge(point).second;
+		auto [a, b] = getEdge(edge);
+		return { (b - a).perpendicular().normalize(), edge };
+	}
+
+	/* Winding number test, open polylines contain nothing */
+	inline bool contains(const vec2_t& p) const override {
+		if (!closed || p.x < min.x || p.y < min.y || p.x > max.x || p.y > max.y) return false;
+		int winding = 0;
+		for (size_t i = 0, len = vertices.size(); i < len; i++) {
+			auto [a, b] = getEdge(i);
+			extent_t side = (b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y);
+			if (a.y <= p.y) {
+				if (b.y > p.y && side > 0) winding++;
+			} else {
+				if (b.y <= p.y && side < 0) winding--;
+			}
+		}
+		return winding != 0;
+	}
+};
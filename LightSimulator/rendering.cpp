@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "rendering.h"
 
+/* The tiles of a tiled image every worker keeps in memory, 12 MB */
+static constexpr size_t TILE_CACHE_SIZE = 128;
+
 static vec2_t getRandomInsideUnitCircle(std::mt19937& randomSource) {
 	vec2_t ret;
 	auto dist = std::uniform_real_distribution<extent_t>(-1, 1);
@@ -15,191 +18,537 @@ static vec2_t getRandomDir(std::mt19937& randomSource) {
 	return getRandomInsideUnitCircle(randomSource).normalize();
 }
 
-void renderWorker_t::executeStep() {
-	auto dist = std::uniform_int_distribution<size_t>(0, pixels.size() - 1);
-	// Delete photons
-	for (size_t i = photons.size() - 1; i >= 0 && i != -1; i--) {
-		auto& photon = photons[i];
-		if (
-			// Check if the photon is outside the area
-			photon.position.x < 0 ||
-			photon.position.y < 0 ||
-			photon.position.x >= space.size.x ||
-			photon.position.y >= space.size.y ||
-			photon.color.getIntensity() < 0.004
-			)
-			photons.erase(photons.begin() + i);
-	}
-
-	for (size_t i = 0, len = photons.size(); i < len; i++) {
-		auto& photon = photons[i];
-
-		// Move photons
-
-		auto oldPos = photon.position;
-
-		auto [shape, dist] = space.getClosestShape(photon.position);
-		if (dist == std::numeric_limits<extent_t>::infinity()) dist = (extent_t)width;
-		if (dist < 1e-10) {
-			photon.color = color_t();
-		} else if (dist < 0.1) {
-			auto normal = shape->getNormal(photon.position);
-			if (shape != photon.lastCollision) {
-				// Collision has occured
-				photon.color = photon.color * shape->reflectivity;
-				photon.direction = reflect(photon.direction, normal);
-				if (shape->roughness != 0) {
-					auto realNormal = normal;
-					if (shape->getDist(photon.position + (realNormal * 0.05)) < dist) {
-						realNormal = -realNormal;
-					}
-					photon.direction = lerp(photon.direction, (realNormal + getRandomDir(randomSource)).normalize(), shape->roughness);
-				}
+/* Spreads the lower 16 bits of the value to the even bits, interleaving two of them makes a Morton code */
+static uint32_t spreadBits(uint32_t value) {
+	value &= 0x0000FFFF;
+	value = (value | (value << 8)) & 0x00FF00FF;
+	value = (value | (value << 4)) & 0x0F0F0F0F;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+size_t splatLine(color_t* target, size_t width, size_t height, const region_t& region, vec2_t from, vec2_t to, const color_t& color) {
+	return walkLine(width, height, region, from, to, [&](int x, int y) {
+		target[x + y * width] = target[x + y * width] + color;
+	});
+}
+
+void renderWorker_t::splat(color_t* target, const vec2_t& from, const vec2_t& to, const color_t& color) {
+	if (tiles) {
+		stats.pixelsSplatted += walkLine(width, height, region, from, to, [&](int x, int y) {
+			tiles->add((size_t)x, (size_t)y, color);
+		});
+	} else stats.pixelsSplatted += splatLine(target, width, height, region, from, to, color);
+}
+
+void renderWorker_t::finishPath(const photon_t& photon) {
+	recordVertex(photon, pathVertex_t::NO_SURFACE);
+	recorder->add(pathSpawners[photon.path], paths[photon.path]);
+	paths[photon.path] = std::vector<pathVertex_t>();
+}
+
+void renderWorker_t::addCost(const vec2_t& point, size_t amount) {
+	// Checked before the cast, points just outside the region would be rounded into the first pixels
+	if (!region.contains(point)) return;
+	int x = (int)((point.x - region.origin.x) / (extent_t)region.size.x * (extent_t)width);
+	int y = (int)((point.y - region.origin.y) / (extent_t)region.size.y * (extent_t)height);
+	if (x >= (int)width || y >= (int)height || x < 0 || y < 0) return;
+	cost[x + y * width] += (uint32_t)amount;
+}
+
+bool floatShapes_t::fits(const space_t& space) {
+	auto& lines = space.objectHolder_t<line_t>::items;
+	auto& circles = space.objectHolder_t<circle_t>::items;
+	return space.objectHolder_t<instance_t>::items.empty() &&
+		space.objectHolder_t<arc_t>::items.empty() &&
+		space.objectHolder_t<bezier_t>::items.empty() &&
+		space.objectHolder_t<polygon_t>::items.empty() &&
+		lines.size() + circles.size() >= MIN_SHAPES &&
+		space.size.x <= MAX_SIZE && space.size.y <= MAX_SIZE;
+}
+
+void floatShapes_t::build(const space_t& space) {
+	auto& lines = space.objectHolder_t<line_t>::items;
+	auto& circles = space.objectHolder_t<circle_t>::items;
+	ax.clear();
+	ay.clear();
+	bx.clear();
+	by.clear();
+	centerX.clear();
+	centerY.clear();
+	radii.clear();
+	shapes.clear();
+	for (auto& line : lines) {
+		ax.push_back((float)line.a.x);
+		ay.push_back((float)line.a.y);
+		bx.push_back((float)line.b.x);
+		by.push_back((float)line.b.y);
+		shapes.push_back(&line);
+	}
+	for (auto& circle : circles) {
+		centerX.push_back((float)circle.center.x);
+		centerY.push_back((float)circle.center.y);
+		radii.push_back((float)circle.radius);
+		shapes.push_back(&circle);
+	}
+	distances.resize(shapes.size());
+}
+
+std::pair<const shape_t*, extent_t> floatShapes_t::getClosest(const vec2_t& point) {
+	auto p = vec2f_t(point);
+	// The distances are written first and searched after, a loop doing both does not vectorize
+	auto lineCount = ax.size();
+	for (size_t i = 0; i < lineCount; i++) {
+		distances[i] = getSegmentDistSquared(p, vec2f_t(ax[i], ay[i]), vec2f_t(bx[i], by[i]));
+	}
+	for (size_t i = 0, len = radii.size(); i < len; i++) {
+		auto dist = getCircleDist(p, vec2f_t(centerX[i], centerY[i]), radii[i]);
+		distances[lineCount + i] = dist * dist;
+	}
+	auto closest = std::min_element(distances.begin(), distances.end());
+	if (closest == distances.end()) return { nullptr, std::numeric_limits<extent_t>::infinity() };
+	auto shape = shapes[closest - distances.begin()];
+	return { shape, shape->getDist(point) };
+}
 
-				photon.lastCollision = shape;
+template <typename real_t, bool rough, bool curved, bool recording, bool heatmap>
+void renderWorker_t::executeKernel() {
+	// Delete photons
+	{
+		statsTimer_t timer(stats.cullTime);
+		for (size_t i = photons.size() - 1; i >= 0 && i != -1; i--) {
+			auto& photon = photons[i];
+			if (
+				// Check if the photon is outside the area
+				photon.position.x < 0 ||
+				photon.position.y < 0 ||
+				photon.position.x >= space.size.x ||
+				photon.position.y >= space.size.y
+				) {
+				stats.killedByExit++;
+				if constexpr (recording) finishPath(photon);
+				photons.erase(photons.begin() + i);
+			} else if (photon.color.getIntensity() < 0.004) {
+				// Embedded photons were already counted when they were found
+				if (!photon.direction.isZero()) stats.killedByIntensity++;
+				if constexpr (recording) finishPath(photon);
+				photons.erase(photons.begin() + i);
 			}
 		}
+	}
 
-		photon.position = photon.position + (photon.direction * dist);
-
-		/// Draw photons
-		// Old x pos
-		int ox = (int)(oldPos.x / (extent_t)space.size.x * (extent_t)width);
-		// Old y pos
-		int oy = (int)(oldPos.y / (extent_t)space.size.y * (extent_t)height);
-		// New x pos
-		int sx = (int)(photon.position.x / (extent_t)space.size.x * (extent_t)width);
-		// New y pos
-		int sy = (int)(photon.position.y / (extent_t)space.size.y * (extent_t)height);
-
-		int x, y, dx, dy, dx1, dy1, px, py, xe, ye;
-		dx = sx - ox;
-		dy = sy - oy;
-		dx1 = std::abs(dx);
-		dy1 = std::abs(dy);
-		px = 2 * dy1 - dx1;
-		py = 2 * dx1 - dy1;
-		if (dy1 <= dx1) {
-			if (dx >= 0) {
-				x = ox;
-				y = oy;
-				xe = sx;
-			} else {
-				x = sx;
-				y = sy;
-				xe = ox;
-			}
-			for (int i = 0; x < xe; i++) {
-				x = x + 1;
-				if (px < 0) {
-					px = px + 2 * dy1;
-				} else {
-					if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) {
-						y = y + 1;
-					} else {
-						y = y - 1;
+	if (sortInterval != 0 && ++stepsSinceSort >= sortInterval) {
+		statsTimer_t timer(stats.sortTime);
+		sortPhotons();
+		stepsSinceSort = 0;
+	}
+
+	stats.marchSteps += photons.size();
+	stats.distanceQueries += photons.size();
+	previousPositions.resize(photons.size());
+
+	// Move photons
+	{
+		statsTimer_t timer(stats.marchTime);
+		for (size_t i = 0, len = photons.size(); i < len; i++) {
+			auto& photon = photons[i];
+
+			previousPositions[i] = photon.position;
+
+			size_t evaluations = 0;
+			const shape_t* shape;
+			extent_t dist;
+			if constexpr (std::is_same_v<real_t, float>) {
+				std::tie(shape, dist) = floatShapes.getClosest(photon.position);
+				evaluations += floatShapes.getShapeCount() + 1;
+			} else std::tie(shape, dist) = space.getClosestShape(photon.position, heatmap && heatmapMode == heatmapMode_e::queries ? &evaluations : nullptr);
+			if (dist == std::numeric_limits<extent_t>::infinity()) dist = (extent_t)width;
+			if (dist < 1e-10) {
+				// The photon is stuck in a wall, zero direction marks it as embedded for the statistics
+				photon.color = color_t();
+				photon.direction = vec2_t();
+				stats.killedByEmbedding++;
+			} else if (dist < 0.1 && shape->contains(photon.position)) {
+				// The photon got inside a solid shape
+				photon.color = color_t();
+				photon.direction = vec2_t();
+				stats.killedByEmbedding++;
+			} else if (dist < 0.1) {
+				auto [normal, part] = shape->getSurface(photon.position);
+				auto isRepeated = shape == photon.lastCollision && part == photon.lastPart;
+				// A curved shape can be hit again right after reflecting from it, the hit is repeated only if the photon is still moving away
+				if constexpr (curved) if (isRepeated && shape->isCurved()) {
+					stats.distanceQueries++;
+					evaluations++;
+					auto away = shape->getDist(photon.position + (normal * (dist * 0.5))) < dist ? -normal : normal;
+					isRepeated = dot(photon.direction, away) >= 0;
+				}
+				if (!isRepeated) {
+					// Collision has occured
+					stats.collisions++;
+					if constexpr (recording) recordVertex(photon, (uint32_t)space.getShapeIndex(shape));
+					photon.color = photon.color * shape->reflectivity;
+					photon.direction = reflect(photon.direction, normal);
+					if constexpr (rough) if (shape->roughness != 0) {
+						auto realNormal = normal;
+						stats.distanceQueries++;
+						evaluations++;
+						if (shape->getDist(photon.position + (realNormal * 0.05)) < dist) {
+							realNormal = -realNormal;
+						}
+						photon.direction = lerp(photon.direction, (realNormal + getRandomDir(randomSource)).normalize(), shape->roughness);
 					}
-					px = px + 2 * (dy1 - dx1);
+
+					photon.lastCollision = shape;
+					photon.lastPart = part;
 				}
-				if (x >= (int)width || y >= (int)height || x < 0 || y < 0) continue;
-				pixels[x + y * width] = pixels[x + y * width] + (photon.color);
 			}
-		} else {
-			if (dy >= 0) {
-				x = ox;
-				y = oy;
-				ye = sy;
-			} else {
-				x = sx;
-				y = sy;
-				ye = oy;
+
+			photon.position = photon.position + (photon.direction * dist);
+
+			if constexpr (heatmap) {
+				if (heatmapMode == heatmapMode_e::steps) addCost(previousPositions[i], 1);
+				else if (heatmapMode == heatmapMode_e::queries) addCost(previousPositions[i], evaluations);
 			}
-			for (int i = 0; y < ye; i++) {
-				y = y + 1;
-				if (py <= 0) {
-					py = py + 2 * dx1;
-				} else {
-					if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) {
-						x = x + 1;
-					} else {
-						x = x - 1;
-					}
-					py = py + 2 * (dx1 - dy1);
-				}
-				if (x >= (int)width || y >= (int)height || x < 0 || y < 0) continue;
-				pixels[x + y * width] = pixels[x + y * width] + (photon.color);
+		}
+	}
+
+	// Measure the photons that crossed a detector in this step
+	if (!space.detectors.empty()) {
+		statsTimer_t timer(stats.detectTime);
+		for (size_t i = 0, len = photons.size(); i < len; i++) {
+			auto& photon = photons[i];
+			for (size_t j = 0, count = space.detectors.size(); j < count; j++) {
+				auto& detector = space.detectors[j];
+				if (!detector.isCrossedBy(previousPositions[i], photon.position)) continue;
+				auto& reading = stats.detectors[j];
+				reading.hits++;
+				reading.energy = reading.energy + photon.color;
+				if (detector.bins != 0) reading.histogram[detector.getBin(photon.direction)]++;
 			}
 		}
 	}
 
+	// Draw photons
+	if (!detectorOnly) {
+		statsTimer_t timer(stats.splatTime);
+		for (size_t i = 0, len = photons.size(); i < len; i++) {
+			// The target is not used when drawing into tiles
+			auto target = layerCount == 0 ? pixels.data() : layers[photons[i].layer].data();
+			splat(target, previousPositions[i], photons[i].position, photons[i].color);
+		}
+	}
+
 	photonsRemaining.store(photons.size());
 }
 
+void renderWorker_t::sortPhotons() {
+	// A grid of 1024 cells along each side of the space, the photons in a cell keep their order
+	constexpr uint32_t CELL_BITS = 10;
+	constexpr uint32_t CELLS = 1 << CELL_BITS;
+
+	auto count = photons.size();
+	sortKeys.resize(count);
+	sortedKeys.resize(count);
+	sortedPhotons.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		auto& position = photons[i].position;
+		// The photons outside the space were just culled, the clamp only guards against rounding
+		auto x = (uint32_t)std::clamp(position.x / space.size.x * CELLS, (extent_t)0, (extent_t)(CELLS - 1));
+		auto y = (uint32_t)std::clamp(position.y / space.size.y * CELLS, (extent_t)0, (extent_t)(CELLS - 1));
+		sortKeys[i] = spreadBits(x) | (spreadBits(y) << 1);
+	}
+
+	// Two passes of CELL_BITS bits, the counts of a pass are 4 kB
+	for (uint32_t shift = 0; shift < CELL_BITS * 2; shift += CELL_BITS) {
+		std::array<uint32_t, CELLS> offsets = {};
+		for (auto key : sortKeys) offsets[(key >> shift) & (CELLS - 1)]++;
+		uint32_t total = 0;
+		for (auto& offset : offsets) {
+			auto digitCount = offset;
+			offset = total;
+			total += digitCount;
+		}
+		for (size_t i = 0; i < count; i++) {
+			auto target = offsets[(sortKeys[i] >> shift) & (CELLS - 1)]++;
+			sortedKeys[target] = sortKeys[i];
+			sortedPhotons[target] = photons[i];
+		}
+		sortKeys.swap(sortedKeys);
+		photons.swap(sortedPhotons);
+	}
+}
+
+void renderWorker_t::selectStep() {
+	// Indexed by the features, roughness is the lowest bit and single precision the highest
+	static constexpr auto STEPS = []<size_t... I>(std::index_sequence<I...>) {
+		return std::array<void (renderWorker_t::*)(), sizeof...(I)>{ &renderWorker_t::executeKernel<std::conditional_t<(I & 16) != 0, float, extent_t>, (I & 1) != 0, (I & 2) != 0, (I & 4) != 0, (I & 8) != 0>... };
+	}(std::make_index_sequence<32>());
+	auto single = floatShapes_t::fits(space);
+	if (single) floatShapes.build(space);
+	auto index = (space.hasRoughness() ? 1 : 0) | (space.hasCurves() ? 2 : 0) | (recorder ? 4 : 0) | (heatmapMode != heatmapMode_e::off ? 8 : 0) | (single ? 16 : 0);
+	step = STEPS[index];
+}
+
 void renderWorker_t::execute() {
+	selectStep();
+	stats = renderStats_t();
+	stats.detectors.resize(space.detectors.size());
+	for (size_t i = 0, len = space.detectors.size(); i < len; i++) {
+		auto& detector = space.detectors[i];
+		stats.detectors[i].name = detector.name.empty() ? std::to_string(i) : detector.name;
+		stats.detectors[i].histogram.resize(detector.bins);
+	}
+	auto spawnTimer = std::make_unique<statsTimer_t>(stats.spawnTime);
 	// Initialize photons
 	photons.resize(photonNum);
-	size_t size = photons.size();
-	photonsRemaining.store(size);
-	// Distribute photons
-	/* The index of the last distributed photon */
-	size_t last = 0;
-	for (auto& spawner : space.spawners) {
-		auto amount = (size_t)(spawner.ratio * photonNum);
+	// Every photon picks its spawner from the table, so the cost does not depend on the amount of spawners
+	if (space.spawnerTable.empty()) photons.clear();
+	if (recorder) {
+		paths.resize(photons.size());
+		pathSpawners.resize(photons.size());
+	}
+	for (auto& photon : photons) {
+		auto index = space.spawnerTable.sample(randomSource);
+		auto& spawner = space.spawners[index];
 		if (spawner.type == spawner_t::type_e::square) {
 			auto xDist = std::uniform_real_distribution(spawner.pos.x - spawner.size.x / 2, spawner.pos.x + spawner.size.x / 2);
 			auto yDist = std::uniform_real_distribution(spawner.pos.y - spawner.size.y / 2, spawner.pos.y + spawner.size.y / 2);
-
-			for (size_t i = last; i < last + amount; i++) {
-				photons[i].position = vec2_t(xDist(randomSource), yDist(randomSource));
-			}
+			photon.position = vec2_t(xDist(randomSource), yDist(randomSource));
 		} else if (spawner.type == spawner_t::type_e::circle) {
-			for (size_t i = last; i < last + amount; i++) {
-				photons[i].position = spawner.pos + (getRandomInsideUnitCircle(randomSource) * spawner.size.x);
-			}
+			photon.position = spawner.pos + (getRandomInsideUnitCircle(randomSource) * spawner.size.x);
+		} else if (spawner.type == spawner_t::type_e::line) {
+			photon.position = spawner.pos + spawner.size * std::uniform_real_distribution<extent_t>(0, 1)(randomSource);
+		}
+		if (layerCount == 0) {
+			photon.color = spawner.color;
+		} else {
+			// The colour is applied when the layers are recombined
+			photon.color = color_t(1, 1, 1);
+			photon.layer = space.spawnerLayers[index];
 		}
-		for (size_t i = last; i < last + amount; i++) {
-			photons[i].color = spawner.color;
-			photons[i].direction = getRandomDir(randomSource);
-			if (spawner.spread < 1) {
-				photons[i].direction = lerp(spawner.direction, photons[i].direction, spawner.spread);
+		photon.direction = getRandomDir(randomSource);
+		if (spawner.spread < 1) {
+			photon.direction = lerp(spawner.direction, photon.direction, spawner.spread);
+		}
+		if (recorder) {
+			photon.path = (uint32_t)(&photon - photons.data());
+			pathSpawners[photon.path] = (uint32_t)index;
+			recordVertex(photon, pathVertex_t::NO_SURFACE);
+		}
+	}
+	stats.photonsSpawned = photons.size();
+	photonsRemaining.store(photons.size());
+
+	// Photons spawned inside solid shapes would only march through the obstacle, they are killed right away
+	if (!space.objectHolder_t<polygon_t>::items.empty()) {
+		for (auto& photon : photons) {
+			if (space.isInsideSolid(photon.position)) {
+				photon.color = color_t();
+				photon.direction = vec2_t();
+				stats.killedByEmbedding++;
 			}
 		}
-		last += amount;
 	}
 
 	// Initialize the pixels
-	pixels.resize(width * height);
-	std::fill(pixels.begin(), pixels.end(), color_t());
+	if (detectorOnly || tiledImage) {
+		// Reused buffers are emptied so they are not merged
+		pixels.clear();
+		for (auto& layer : layers) layer.clear();
+		if (tiledImage && !detectorOnly) tiles.emplace(*tiledImage, TILE_CACHE_SIZE);
+	} else if (layerCount == 0) {
+		pixels.resize(width * height);
+		std::fill(pixels.begin(), pixels.end(), color_t());
+	} else {
+		layers.resize(layerCount);
+		for (auto& layer : layers) {
+			layer.resize(width * height);
+			std::fill(layer.begin(), layer.end(), color_t());
+		}
+	}
+	if (heatmapMode != heatmapMode_e::off) cost.assign(width * height, 0);
+	spawnTimer.reset();
 	// Start render loop
-	while (!photons.empty()) {
+	while (!photons.empty() && !cancelled.load(std::memory_order_relaxed)) {
 		executeStep();
 	}
+	if (recorder) {
+		// The photons left by a cancelled render end where they are, like in the image
+		for (auto& photon : photons) finishPath(photon);
+		recorder->flush();
+	}
+	if (tiles) {
+		statsTimer_t timer(stats.splatTime);
+		tiles->flush();
+		tiles.reset();
+	}
 }
 
-void renderWorker_t::startThread() {
-	thread = std::thread([this]() {
-		execute();
+void renderWorker_t::start(threadPool_t& pool) {
+	task = pool.submit([this]() {
+		std::exception_ptr error;
+		// Workers still queued when the render is cancelled return right away
+		bool executed = !cancelled;
+		if (executed) {
+			try {
+				execute();
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+		if (!executed || error) {
+			// The reused buffers were never cleared or are not complete, they are emptied so they are not merged
+			pixels.clear();
+			for (auto& layer : layers) layer.clear();
+		}
+		// The reduction waits for every worker, so the workers with nothing to add are merged too
+		if (reduction) {
+			statsTimer_t timer(stats.mergeTime);
+			std::vector<const std::vector<color_t>*> buffers;
+			if (layerCount == 0) buffers.push_back(&pixels);
+			else for (auto& layer : layers) buffers.push_back(&layer);
+			reduction->merge(buffers, index);
+		}
+		if (error) std::rethrow_exception(error);
 	});
 }
 
-renderWorker_t::renderWorker_t(const space_t& space, size_t photonNum, size_t width, size_t height) : photonNum(photonNum), width(width), space(space), height(height) {
+reduction_t::reduction_t(std::vector<std::vector<color_t>> sums, std::vector<std::vector<color_t>*> image, size_t workerCount) : sums(std::move(sums)), image(std::move(image)), workerCount(workerCount) {
+	auto size = this->sums.empty() ? 0 : this->sums.front().size();
+	// Stripes of 64 kB of every buffer, a worker holds the lock of one for about a microsecond per buffer
+	stripeSize = std::max((size_t)(65536 / sizeof(color_t)), (size_t)1);
+	stripes = std::vector<stripe_t>((size + stripeSize - 1) / stripeSize);
+}
+
+void reduction_t::addStripe(size_t index, const std::vector<const std::vector<color_t>*>& buffers) {
+	auto& stripe = stripes[index];
+	auto first = stripe.merged == 0;
+	auto last = stripe.merged + 1 == workerCount;
+	for (size_t i = 0, len = sums.size(); i < len; i++) {
+		auto& sum = sums[i];
+		auto start = index * stripeSize;
+		auto count = std::min(stripeSize, sum.size() - start) * 3;
+		auto target = (extent_t*)(sum.data() + start);
+		auto source = i < buffers.size() && buffers[i]->size() == sum.size() ? (const extent_t*)(buffers[i]->data() + start) : nullptr;
+		// The sums are not cleared, the first worker overwrites them
+		if (first && source) std::memcpy(target, source, count * sizeof(extent_t));
+		else if (first) std::fill(target, target + count, (extent_t)0);
+		else if (source) for (size_t j = 0; j < count; j++) target[j] += source[j];
+		if (last && image[i]->size() == sum.size()) {
+			auto pixels = (const extent_t*)(image[i]->data() + start);
+			for (size_t j = 0; j < count; j++) target[j] += pixels[j];
+		}
+	}
+	stripe.merged++;
+}
+
+void reduction_t::swapInto(std::vector<std::vector<color_t>>& spareBuffers) {
+	for (size_t i = 0, len = sums.size(); i < len; i++) {
+		image[i]->swap(sums[i]);
+		spareBuffers.push_back(std::move(sums[i]));
+	}
+	sums.clear();
+}
+
+void reduction_t::merge(const std::vector<const std::vector<color_t>*>& buffers, size_t workerIndex) {
+	// Every worker starts at another stripe and skips the stripes locked by others, they are added in a later pass
+	std::vector<size_t> pending;
+	pending.reserve(stripes.size());
+	auto offset = stripes.empty() ? 0 : workerIndex * stripes.size() / workerCount;
+	for (size_t i = 0, len = stripes.size(); i < len; i++) pending.push_back((offset + i) % len);
+	while (!pending.empty()) {
+		auto iter = std::remove_if(pending.begin(), pending.end(), [&](size_t index) {
+			std::unique_lock<std::mutex> lock(stripes[index].mutex, std::try_to_lock);
+			if (!lock.owns_lock()) return false;
+			addStripe(index, buffers);
+			return true;
+		});
+		// All stripes left are being added by others, waiting for the first instead of spinning
+		if (iter == pending.end()) {
+			std::unique_lock<std::mutex> lock(stripes[pending.front()].mutex);
+			addStripe(pending.front(), buffers);
+			pending.erase(pending.begin());
+		} else pending.erase(iter, pending.end());
+	}
+}
+
+renderWorker_t::renderWorker_t(spaceSnapshot_t space, size_t photonNum, size_t width, size_t height) : photonNum(photonNum), width(width), snapshot(std::move(space)), space(*snapshot), height(height) {
 	// All alocations will be done on a separate thread in execute()
+	region = region_t{ vec2_t(0, 0), this->space.size };
 };
 
 static std::random_device randomDevice;
 
-void batchController_t::startRendering(const space_t& space, size_t photonNum, size_t threadCount) {
+void batchController_t::startRendering(spaceSnapshot_t space, size_t photonNum, size_t threadCount, std::optional<std::mt19937::result_type> seed) {
+	// A render still running is replaced
+	cancel();
+	// Tiled images are drawn without layers
+	if (layered && !isTiled()) {
+		if (space->layerNames != layerNames || layers.size() != layerNames.size()) {
+			// The image is made of the layers from now on
+			resetLayers(*space);
+			clear();
+		}
+	} else if (!layerNames.empty()) {
+		layers.clear();
+		layerNames.clear();
+		layerLights.clear();
+		clear();
+	}
+	// The recording is opened by the first render, so clearing the image costs nothing when nothing is rendered
+	if (!recordPath.empty() && !pathWriter) pathWriter = std::make_shared<pathWriter_t>(recordPath, *space);
+	// Tiled images are added to by the workers themselves and detectors change no pixels
+	reduction.reset();
+	if (!tiledImage && !detectorOnly) {
+		std::vector<std::vector<color_t>> sums;
+		std::vector<std::vector<color_t>*> image;
+		if (layered) {
+			for (auto& layer : layers) {
+				sums.push_back(takeBuffer());
+				image.push_back(&layer);
+			}
+		} else {
+			sums.push_back(takeBuffer());
+			image.push_back(&pixels);
+		}
+		reduction = std::make_shared<reduction_t>(std::move(sums), std::move(image), threadCount);
+	}
+	photonsPending = 0;
 	/* The amount of photons for one worker */
 	auto countForOne = photonNum / threadCount;
 
 	workers.resize(threadCount);
-	for (auto& worker : workers) {
+	for (size_t i = 0; i < threadCount; i++) {
+		auto& worker = workers[i];
 		worker = std::make_unique<renderWorker_t>(space, countForOne, width, height);
-		worker->sourceRandom(randomDevice);
+		worker->setLayered(layered && !isTiled());
+		worker->setTiledImage(tiledImage);
+		if (!layered && !isTiled() && !spareBuffers.empty()) {
+			worker->pixels = std::move(spareBuffers.back());
+			spareBuffers.pop_back();
+		}
+		for (size_t j = 0; layered && !isTiled() && j < layerNames.size() && !spareBuffers.empty(); j++) {
+			worker->layers.push_back(std::move(spareBuffers.back()));
+			spareBuffers.pop_back();
+		}
+		worker->setPathWriter(pathWriter);
+		worker->setReduction(reduction, i);
+		worker->setDetectorOnly(detectorOnly);
+		worker->setSortInterval(sortInterval);
+		worker->setRegion(getRegion(*space));
+		if (seed) worker->seedRandom(*seed + (std::mt19937::result_type)i);
+		else worker->sourceRandom(randomDevice);
+		// The march cost would need a buffer of the size of the image
+		worker->setHeatmapMode(isTiled() ? heatmapMode_e::off : heatmapMode);
 	}
+	stats = renderStats_t();
+	renderStart = std::chrono::steady_clock::now();
 
+	auto& pool = threadPool_t::getShared();
 	for (auto& worker : workers) {
-		worker->startThread();
+		worker->start(pool);
 	}
 
 	initialWorkerNum = workers.size();
@@ -209,6 +558,20 @@ bool batchController_t::isDone() {
 	return workers.empty();
 }
 
+bool batchController_t::cancel() {
+	cancelReplay();
+	if (workers.empty()) return false;
+	for (auto& worker : workers) {
+		if (worker) worker->cancel();
+	}
+	for (auto& worker : workers) {
+		if (worker) worker->wait();
+	}
+	// The workers are done now, so this merges all of them
+	update();
+	return true;
+}
+
 double batchController_t::update() {
 	double remaining = 0;
 	// Calculating the percentage of photons remaining
@@ -218,40 +581,126 @@ double batchController_t::update() {
 	}
 
 	remaining /= initialWorkerNum;
-	/// Removing the finished workers
+	/// Removing the finished workers, their pixels were already added by the reduction
 	auto iter = std::remove_if(workers.begin(), workers.end(), [this](std::unique_ptr<renderWorker_t>& worker) {
 		if (!worker) return true;
 		if (worker->isDone()) {
 			worker->join();
-			auto myPixels = (extent_t*)pixels.data();
-			auto theirPixels = (extent_t*)worker->pixels.data();
-			for (size_t i = 0, len = pixels.size() * 3; i < len; i++) {
-				myPixels[i] += theirPixels[i];
+			{
+				statsTimer_t timer(stats.mergeTime);
+				// Workers cancelled before they started have no pixels, their buffers are still kept for the next render
+				if (worker->pixels.capacity() != 0) spareBuffers.push_back(std::move(worker->pixels));
+				for (auto& layer : worker->layers) {
+					if (layer.capacity() != 0) spareBuffers.push_back(std::move(layer));
+				}
+				if (!worker->cost.empty()) {
+					if (cost.size() != pixels.size()) cost.assign(pixels.size(), 0);
+					for (size_t i = 0, len = cost.size(); i < len; i++) {
+						cost[i] += worker->cost[i];
+					}
+				}
 			}
-			pixelsDirty = true;
+			stats += worker->getStats();
+			photonsPending += worker->getStats().photonsSpawned;
+			stats.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
 			return true;
 		} else return false;
 	});
 
-	if (iter != workers.end()) workers.erase(iter);
+	if (iter == workers.end()) return 1 - remaining;
+	workers.erase(iter, workers.end());
+	if (workers.empty()) {
+		statsTimer_t timer(stats.mergeTime);
+		// Every worker is merged, the sums replace the image and the old image is a spare buffer
+		if (reduction) {
+			reduction->swapInto(spareBuffers);
+			reduction.reset();
+			// The layers are only kept by renders with layers
+			if (!layers.empty()) recombine();
+		}
+		photonsAccumulated += photonsPending;
+		photonsPending = 0;
+		pixelsDirty = true;
+	}
 	// Invert the remaining because it contains the percentage of photons remaining and we want the percetage of photons done
 	return 1 - remaining;
 }
 
+std::vector<color_t> batchController_t::takeBuffer() {
+	if (spareBuffers.empty()) return std::vector<color_t>(width * height);
+	auto buffer = std::move(spareBuffers.back());
+	spareBuffers.pop_back();
+	buffer.resize(width * height);
+	return buffer;
+}
+
+void batchController_t::recombine() {
+	std::fill(pixels.begin(), pixels.end(), color_t());
+	// One pass over the plain array of every layer with the colour as three factors
+	auto target = (extent_t*)pixels.data();
+	for (size_t i = 0, len = layers.size(); i < len; i++) {
+		auto color = layerLights[i].color * layerLights[i].weight;
+		auto source = (const extent_t*)layers[i].data();
+		for (size_t j = 0, count = pixels.size() * 3; j < count; j += 3) {
+			target[j] += source[j] * color.r;
+			target[j + 1] += source[j + 1] * color.g;
+			target[j + 2] += source[j + 2] * color.b;
+		}
+	}
+	pixelsDirty = true;
+}
+
+void batchController_t::resetLayers(const space_t& space) {
+	layerNames = space.layerNames;
+	layers.assign(layerNames.size(), std::vector<color_t>(width * height));
+	layerLights.assign(layerNames.size(), layerLight_t());
+	for (size_t i = space.spawners.size(); i-- > 0;) {
+		layerLights[space.spawnerLayers[i]].color = space.spawners[i].color;
+	}
+}
+
+void batchController_t::setLayerLight(size_t layer, const layerLight_t& light) {
+	layerLights[layer] = light;
+	recombine();
+}
+
 void batchController_t::resize(size_t width, size_t height) {
 	if (width == this->width && height == this->height)
 		return;
 	this->width = width;
 	this->height = height;
 
-	pixels.resize(width * height);
+	if (isTiled()) {
+		tiledImage.reset();
+		if (width * height != 0) tiledImage = std::make_shared<tiledImage_t>(tiledPath, width, height);
+	} else pixels.resize(width * height);
+	for (auto& layer : layers) layer.resize(width * height);
+	spareBuffers.clear();
+	clear();
+}
+
+void batchController_t::setTiledPath(const std::filesystem::path& path) {
+	cancel();
+	// The file is deleted once no save reads it anymore
+	tiledImage.reset();
+	tiledPath = path;
+	if (isTiled()) {
+		// Releasing the memory is the point of tiled images
+		pixels = std::vector<color_t>();
+		spareBuffers.clear();
+		layers.clear();
+		layerNames.clear();
+		layerLights.clear();
+		if (width * height != 0) tiledImage = std::make_shared<tiledImage_t>(tiledPath, width, height);
+	} else pixels.assign(width * height, color_t());
 	clear();
 }
 
 void batchController_t::drawPreview(SDL_Surface* surface, const SDL_Rect& rect, double zoom) {
-	if (!pixels.empty()) {
+	if (!pixels.empty() || tiledImage) {
 		if (pixelsDirty || !cacheSurface || cacheSurface->w != rect.w || cacheSurface->h != rect.h) {
-			cacheSurface = draw(rect.w, rect.h);
+			if (showHeatmap && hasHeatmap()) cacheSurface = drawHeatmap(rect.w, rect.h);
+			else cacheSurface = draw(rect.w, rect.h);
 		}
 
 		auto copy = rect;
@@ -260,6 +709,12 @@ void batchController_t::drawPreview(SDL_Surface* surface, const SDL_Rect& rect,
 	pixelsDirty = false;
 }
 
+static inline Uint8 tonemap(extent_t value, extent_t multiplier) {
+	value = value * 255 * multiplier;
+	if (value >= 256) value = 255;
+	return (Uint8)value;
+}
+
 sdlhelp::unique_surface_ptr batchController_t::draw(int w, int h) {
 	if (w <= 0) w = (int)width;
 	if (h <= 0) h = (int)height;
@@ -267,26 +722,190 @@ sdlhelp::unique_surface_ptr batchController_t::draw(int w, int h) {
 	surface.reset(sdlhelp::handleSDLError(SDL_CreateRGBSurface(0, w, h, 32, 0, 0, 0, 0)));
 	auto surfacePtr = surface.get();
 	auto myPixels = pixels.data();
+	auto exposure = getExposure();
 	double xZoom = (double)w / (double)width;
 	double yZoom = (double)h / (double)height;
-	for (int y = 0; y < w; y++)
-		for (int x = 0; x < h; x++) {
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			auto pX = (size_t)((double)x / xZoom);
+			auto pY = (size_t)((double)y / yZoom);
+			// Tiled images are sampled from the file, only the pixels shown are read
+			auto& pixel = tiledImage ? tiledImage->getPixel(pX, pY) : myPixels[pX + pY * width];
+			SDL_Rect target = { x, y, 1, 1 };
+			SDL_FillRect(surfacePtr, &target, SDL_MapRGB(surface->format, tonemap(pixel.r, exposure), tonemap(pixel.g, exposure), tonemap(pixel.b, exposure)));
+		}
+	return surface;
+}
+
+/* Maps 0 - 1 to a black, purple, red, yellow ramp */
+static void heatColor(double t, Uint8* target) {
+	constexpr Uint8 STOPS[][3] = { { 0, 0, 0 }, { 87, 16, 110 }, { 188, 55, 84 }, { 249, 142, 9 }, { 252, 255, 164 } };
+	constexpr size_t LAST = sizeof(STOPS) / sizeof(STOPS[0]) - 1;
+	if (t < 0) t = 0;
+	if (t > 1) t = 1;
+	auto position = t * LAST;
+	auto index = std::min((size_t)position, LAST - 1);
+	auto fraction = position - (double)index;
+	for (size_t i = 0; i < 3; i++) {
+		target[i] = (Uint8)(STOPS[index][i] + (STOPS[index + 1][i] - STOPS[index][i]) * fraction);
+	}
+}
+
+/* The opacity of the heat colour of the most expensive pixel over the image, cheaper pixels show more of the image */
+static constexpr double HEATMAP_OPACITY = 0.75;
+
+/* Returns the scale for heatColor, so the most expensive pixel gets 1 */
+static double getHeatScale(const std::vector<uint64_t>& cost) {
+	auto max = cost.empty() ? 0 : *std::max_element(cost.begin(), cost.end());
+	return max == 0 ? 0 : 1 / std::log1p((double)max);
+}
+
+sdlhelp::unique_surface_ptr batchController_t::drawHeatmap(int w, int h) {
+	if (w <= 0) w = (int)width;
+	if (h <= 0) h = (int)height;
+	sdlhelp::unique_surface_ptr surface;
+	surface.reset(sdlhelp::handleSDLError(SDL_CreateRGBSurface(0, w, h, 32, 0, 0, 0, 0)));
+	auto scale = getHeatScale(cost);
+	auto exposure = getExposure();
+	// The pixels are empty when only the detectors were measured, the cost is then drawn over black
+	auto hasImage = pixels.size() == cost.size();
+	double xZoom = (double)w / (double)width;
+	double yZoom = (double)h / (double)height;
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
 			auto pX = (size_t)((double)x / xZoom);
 			auto pY = (size_t)((double)y / yZoom);
 			auto index = pX + pY * width;
-			auto r = myPixels[index].r * 255 * multiplier;
-			auto g = myPixels[index].g * 255 * multiplier;
-			auto b = myPixels[index].b * 255 * multiplier;
-			if (r >= 256) r = 255;
-			if (g >= 256) g = 255;
-			if (b >= 256) b = 255;
+			auto heat = std::log1p((double)cost[index]) * scale;
+			Uint8 color[3];
+			heatColor(heat, color);
+			auto alpha = HEATMAP_OPACITY * heat;
+			auto pixel = hasImage ? pixels[index] : color_t();
+			auto blend = [&](extent_t value, Uint8 heatValue) {
+				return (Uint8)(tonemap(value, exposure) * (1 - alpha) + heatValue * alpha);
+			};
 			SDL_Rect target = { x, y, 1, 1 };
-			SDL_FillRect(surfacePtr, &target, SDL_MapRGB(surface->format, (Uint8)r, (Uint8)g, (Uint8)b));
+			SDL_FillRect(surface.get(), &target, SDL_MapRGB(surface->format, blend(pixel.r, color[0]), blend(pixel.g, color[1]), blend(pixel.b, color[2])));
 		}
 	return surface;
 }
 
-void batchController_t::clear() {
+imageSource_t batchController_t::snapshotHeatmap() const {
+	imageSource_t image;
+	if (cost.empty()) return image;
+	image.width = width;
+	image.height = height;
+	image.fillRow = [cost = std::make_shared<const std::vector<uint64_t>>(cost), width = width, scale = getHeatScale(cost)](size_t y, Uint8* row) {
+		auto source = cost->data() + y * width;
+		for (size_t x = 0; x < width; x++) {
+			heatColor(std::log1p((double)source[x]) * scale, row + x * 3);
+		}
+	};
+	return image;
+}
+
+imageSource_t batchController_t::snapshot() const {
+	if (tiledImage) return tiledImage_t::snapshot(tiledImage, getExposure());
+	imageSource_t image;
+	image.width = width;
+	image.height = height;
+	image.fillRow = [pixels = std::make_shared<const std::vector<color_t>>(pixels), width = width, multiplier = getExposure()](size_t y, Uint8* row) {
+		auto source = pixels->data() + y * width;
+		for (size_t x = 0; x < width; x++) {
+			row[x * 3 + 0] = tonemap(source[x].r, multiplier);
+			row[x * 3 + 1] = tonemap(source[x].g, multiplier);
+			row[x * 3 + 2] = tonemap(source[x].b, multiplier);
+		}
+	};
+	return image;
+}
+
+void batchController_t::clearImage() {
+	// The reduction would add the workers to the old image
+	cancel();
 	std::fill(pixels.begin(), pixels.end(), color_t());
+	if (tiledImage) {
+		// A save still reading the image keeps it, the render goes on in a new one
+		if (tiledImage->isRead()) tiledImage = std::make_shared<tiledImage_t>(tiledPath, width, height);
+		else tiledImage->clear();
+	}
+	for (auto& layer : layers) std::fill(layer.begin(), layer.end(), color_t());
+	cost.clear();
+	photonsAccumulated = 0;
 	pixelsDirty = true;
+}
+
+void batchController_t::clear() {
+	clearImage();
+	pathWriter.reset();
+}
+
+void batchController_t::setRecordPath(const std::filesystem::path& path) {
+	recordPath = path;
+	pathWriter.reset();
+}
+
+void batchController_t::startReplay(spaceSnapshot_t space, size_t width, size_t height) {
+	cancel();
+	if (!pathWriter) throw std::runtime_error("Nothing was recorded since the image was cleared");
+	pathWriter->flush();
+	startReplay(pathWriter->getPath(), std::move(space), width, height);
+}
+
+void batchController_t::startReplay(const std::filesystem::path& path, spaceSnapshot_t space, size_t width, size_t height) {
+	cancel();
+	if (isTiled()) throw std::runtime_error("Paths cannot be replayed into a tiled image");
+	// Another file is not the recording of the image anymore
+	if (pathWriter && pathWriter->getPath() != path) pathWriter.reset();
+
+	replayJob = std::make_unique<replayJob_t>();
+	replayJob->space = std::move(space);
+	replayJob->width = width;
+	replayJob->height = height;
+	replayJob->layered = layered;
+	replayJob->thread = std::thread([job = replayJob.get(), path, region = getRegion(*replayJob->space)]() {
+		try {
+			job->result = replayPaths(path, *job->space, job->targets, job->width, job->height, region, job->layered, &job->cancelled);
+		} catch (...) {
+			job->error = std::current_exception();
+		}
+		job->done = true;
+	});
+}
+
+std::optional<pathReplay_t> batchController_t::pollReplay() {
+	if (!replayJob || !replayJob->done) return std::nullopt;
+	// Taken before the image is cleared, which would discard it
+	auto job = std::move(replayJob);
+	job->thread.join();
+	if (job->error) std::rethrow_exception(job->error);
+
+	auto& space = *job->space;
+	width = job->width;
+	height = job->height;
+	spareBuffers.clear();
+	clearImage();
+	if (job->layered) {
+		if (space.layerNames != layerNames) resetLayers(space);
+		layers = std::move(job->targets);
+		pixels.assign(width * height, color_t());
+		recombine();
+	} else {
+		layers.clear();
+		layerNames.clear();
+		layerLights.clear();
+		pixels = std::move(job->targets.front());
+	}
+	stats = renderStats_t();
+	stats.photonsSpawned = job->result.photons;
+	stats.wallTime = job->result.time;
+	photonsAccumulated = job->result.photons;
+	return job->result;
+}
+
+void batchController_t::cancelReplay() {
+	if (!replayJob) return;
+	replayJob->cancelled = true;
+	replayJob->thread.join();
+	replayJob.reset();
 }
\ No newline at end of file
@@ -3,12 +3,193 @@
 #include "vectors.h"
 #include "space.h"
 #include "exceptions.h"
+#include "pngEncoder.h"
+#include "stats.h"
+#include "threadPool.h"
+#include "pathLog.h"
+#include "tiledImage.h"
+
+/* How a layer is lit when the image is recombined */
+struct layerLight_t {
+	color_t color;
+	extent_t weight = 1;
+};
+
+/* What the march cost channel counts per pixel */
+enum class heatmapMode_e {
+	off,
+	/* March steps started in the pixel */
+	steps,
+	/* Shape distance functions evaluated for the steps started in the pixel */
+	queries
+};
 
 struct photon_t {
 	vec2_t position;
 	vec2_t direction;
 	color_t color;
 	const shape_t* lastCollision = nullptr;
+	size_t lastPart = 0;
+	/* The layer the photon is drawn into, when rendering with layers */
+	uint32_t layer = 0;
+	/* The index of the recorded path of the photon, when recording paths */
+	uint32_t path = 0;
+};
+
+/* Calls plot with the coordinates of every pixel of the image on the line between two points in space coordinates, returns the amount of pixels. The image shows the region, only the part of the line inside it is walked */
+template <typename F>
+inline size_t walkLine(size_t width, size_t height, const region_t& region, vec2_t from, vec2_t to, F plot) {
+	size_t splatted = 0;
+	// The part outside the region is cut off, so lines crossing a small region do not walk all the pixels they would have outside of it
+	if (!region.clip(from, to)) return 0;
+	from = from - region.origin;
+	to = to - region.origin;
+	// Old x pos
+	int ox = (int)(from.x / (extent_t)region.size.x * (extent_t)width);
+	// Old y pos
+	int oy = (int)(from.y / (extent_t)region.size.y * (extent_t)height);
+	// New x pos
+	int sx = (int)(to.x / (extent_t)region.size.x * (extent_t)width);
+	// New y pos
+	int sy = (int)(to.y / (extent_t)region.size.y * (extent_t)height);
+
+	int x, y, dx, dy, dx1, dy1, px, py, xe, ye;
+	dx = sx - ox;
+	dy = sy - oy;
+	dx1 = std::abs(dx);
+	dy1 = std::abs(dy);
+	px = 2 * dy1 - dx1;
+	py = 2 * dx1 - dy1;
+	if (dy1 <= dx1) {
+		if (dx >= 0) {
+			x = ox;
+			y = oy;
+			xe = sx;
+		} else {
+			x = sx;
+			y = sy;
+			xe = ox;
+		}
+		for (int i = 0; x < xe; i++) {
+			x = x + 1;
+			if (px < 0) {
+				px = px + 2 * dy1;
+			} else {
+				if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) {
+					y = y + 1;
+				} else {
+					y = y - 1;
+				}
+				px = px + 2 * (dy1 - dx1);
+			}
+			if (x >= (int)width || y >= (int)height || x < 0 || y < 0) continue;
+			plot(x, y);
+			splatted++;
+		}
+	} else {
+		if (dy >= 0) {
+			x = ox;
+			y = oy;
+			ye = sy;
+		} else {
+			x = sx;
+			y = sy;
+			ye = oy;
+		}
+		for (int i = 0; y < ye; i++) {
+			y = y + 1;
+			if (py <= 0) {
+				py = py + 2 * dx1;
+			} else {
+				if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) {
+					x = x + 1;
+				} else {
+					x = x - 1;
+				}
+				py = py + 2 * (dx1 - dy1);
+			}
+			if (x >= (int)width || y >= (int)height || x < 0 || y < 0) continue;
+			plot(x, y);
+			splatted++;
+		}
+	}
+	return splatted;
+}
+
+/* Adds the color to all pixels of the target on the line between two points in space coordinates, returns the amount of pixels drawn. The target shows the region, only the part of the line inside it is drawn */
+size_t splatLine(color_t* target, size_t width, size_t height, const region_t& region, vec2_t from, vec2_t to, const color_t& color);
+
+/*
+	The lines and circles of a space in single precision, which the float march kernels scan for the
+	closest shape. A SIMD register holds twice as many floats as doubles, so the scan of many shapes
+	takes about half the time. The distance of the shape found is then measured again in double
+	precision, so only shapes closer together than the float error can be mixed up
+*/
+class floatShapes_t {
+protected:
+	/* One array per coordinate, so the scan over them vectorizes */
+	std::vector<float> ax;
+	std::vector<float> ay;
+	std::vector<float> bx;
+	std::vector<float> by;
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> radii;
+	/* The lines and then the circles */
+	std::vector<const shape_t*> shapes;
+	/* The squared distances of the last scan */
+	std::vector<float> distances;
+
+public:
+	/* Spaces with fewer shapes are scanned faster in double precision than in float and again in double */
+	static constexpr size_t MIN_SHAPES = 32;
+	/* Past this size the float error of a distance gets close to the collision distance */
+	static constexpr extent_t MAX_SIZE = 10000;
+
+	/* True if the space has only lines and circles, enough of them and is small enough */
+	static bool fits(const space_t& space);
+	void build(const space_t& space);
+	/* Returns the closest shape and its distance in double precision */
+	std::pair<const shape_t*, extent_t> getClosest(const vec2_t& point);
+	inline size_t getShapeCount() const { return shapes.size(); }
+};
+
+/*
+	Adds up the buffers of the workers of a render on the pool, every worker adds its own buffers
+	when it returns while the others are still rendering. The buffers are split into stripes and a
+	worker adds the stripes no other worker is adding to first, so workers returning together do not
+	wait for each other. The last worker adding a stripe also adds the stripe of the image, so once
+	every worker is merged the sums are the new image and the controller only swaps them in.
+*/
+class reduction_t {
+protected:
+	struct stripe_t {
+		std::mutex mutex;
+		/* The amount of workers that added the stripe */
+		size_t merged = 0;
+	};
+
+	/* The pixels, or the layers, of the image plus the workers */
+	std::vector<std::vector<color_t>> sums;
+	/* The buffers of the image the render adds to, they are only read while the render runs */
+	std::vector<std::vector<color_t>*> image;
+	std::vector<stripe_t> stripes;
+	size_t stripeSize;
+	size_t workerCount;
+
+	/* Adds the stripe of the buffers of a worker, buffers with another size than the sums are skipped */
+	void addStripe(size_t index, const std::vector<const std::vector<color_t>*>& buffers);
+
+public:
+	/* Adds the buffers of a worker, one for every sum. Must be called exactly once by every worker of the render, also by the ones with no buffers */
+	void merge(const std::vector<const std::vector<color_t>*>& buffers, size_t workerIndex);
+	/* Replaces the buffers of the image with the sums, the old buffers are added to the spare buffers. Only valid when every worker was merged */
+	void swapInto(std::vector<std::vector<color_t>>& spareBuffers);
+
+	/* The sums are overwritten, they only need to have the size of the image */
+	reduction_t(std::vector<std::vector<color_t>> sums, std::vector<std::vector<color_t>*> image, size_t workerCount);
+	reduction_t(const reduction_t&) = delete;
+	reduction_t& operator=(const reduction_t&) = delete;
 };
 
 class renderWorker_t {
@@ -16,23 +197,107 @@ protected:
 	size_t width;
 	size_t height;
 	std::vector<photon_t> photons;
+	/* Keeps the space alive while the worker reads it */
+	spaceSnapshot_t snapshot;
 	const space_t& space;
-	std::thread thread;
+	/* Ready when execute() returned on the pool */
+	std::future<void> task;
+	/* Checked before every step, the photons left are dropped when set */
+	std::atomic<bool> cancelled = false;
 
 	std::atomic<size_t> photonsRemaining;
 	size_t photonNum;
 	std::mt19937 randomSource;
+	/* Positions of the photons before the current step, used to draw the photons after they all moved */
+	std::vector<vec2_t> previousPositions;
+	renderStats_t stats;
+	heatmapMode_e heatmapMode = heatmapMode_e::off;
+	/* The part of the space the pixels show */
+	region_t region;
+	/* Zero when the photons are drawn into pixels, otherwise the amount of layers */
+	size_t layerCount = 0;
+	/* When set nothing is drawn and no pixels are allocated, only the detectors measure the photons */
+	bool detectorOnly = false;
+	/* Set when the paths of the photons are recorded */
+	std::optional<pathRecorder_t> recorder;
+	/* The vertices of every photon so far, by photon_t::path */
+	std::vector<std::vector<pathVertex_t>> paths;
+	/* The spawner of every path */
+	std::vector<uint32_t> pathSpawners;
+	/* When set the photons are drawn into the tiles of this image instead of the pixels */
+	std::shared_ptr<tiledImage_t> tiledImage;
+	/* The tiles of the tiled image drawn into, added to it when evicted and when the worker returns */
+	std::optional<tileCache_t> tiles;
+	/* The buffers are added to it when the worker returns, if set */
+	std::shared_ptr<reduction_t> reduction;
+	size_t index = 0;
+	/* The photons are sorted by their position every this many steps, zero to keep them in the order they were spawned in */
+	size_t sortInterval = 0;
+	/* Steps since the photons were last sorted */
+	size_t stepsSinceSort = 0;
+	/* The keys of the photons and the buffers the sort moves them into */
+	std::vector<uint32_t> sortKeys;
+	std::vector<uint32_t> sortedKeys;
+	std::vector<photon_t> sortedPhotons;
 
-	/* Rendering step. Called from execute() */
-	void executeStep();
+	/* The step compiled for the features used by the space and the worker, picked by selectStep() */
+	void (renderWorker_t::*step)() = nullptr;
+	/* The shapes of the space for the float steps, only built when one is picked */
+	floatShapes_t floatShapes;
+
+	/*
+		Rendering step. Every combination of the features has its own copy, the checks for the features
+		that are off are left out at compile time instead of being made for every photon and collision.
+		The closest shape is found in the precision real_t, see floatShapes_t
+	*/
+	template <typename real_t, bool rough, bool curved, bool recording, bool heatmap>
+	void executeKernel();
+	/* Picks the step for the shapes of the space and the settings of the worker, called by execute() */
+	void selectStep();
+	/* Runs the picked step. Called from execute() */
+	inline void executeStep() {
+		if (!step) selectStep();
+		(this->*step)();
+	}
+	/*
+		Orders the photons by the Morton code of their position with a radix sort, so the photons
+		marched one after another are close together. After a few bounces they are all over the space,
+		and the shapes and pixels of consecutive photons would not be in the cache anymore
+	*/
+	void sortPhotons();
+	/* Draws the line with splatLine(), or into the tiles, and counts the pixels */
+	void splat(color_t* target, const vec2_t& from, const vec2_t& to, const color_t& color);
+	/* Adds to the march cost of the pixel at the point in space coordinates */
+	void addCost(const vec2_t& point, size_t amount);
+	/* Adds the current position of the photon to its path */
+	inline void recordVertex(const photon_t& photon, uint32_t surface) {
+		paths[photon.path].push_back(pathVertex_t{ (float)photon.position.x, (float)photon.position.y, surface });
+	}
+	/* Ends the path of the photon at its current position and hands it to the recorder */
+	void finishPath(const photon_t& photon);
 public:
 	std::vector<color_t> pixels;
+	/* When rendering with layers, the pixels of every layer of the space, drawn with unit colour. The pixels are then empty */
+	std::vector<std::vector<color_t>> layers;
+	/* March cost per pixel, only allocated when the heatmap mode is not off */
+	std::vector<uint32_t> cost;
 	/* Allocates all resources and runs the render loop. The code that should run on a separate thread. */
 	void execute();
-	void startThread();
+	/* Runs execute() on the pool */
+	void start(threadPool_t& pool);
+	/* Makes execute() return after the current step, the pixels then contain only the finished steps */
+	inline void cancel() {
+		cancelled = true;
+	}
 
+	/* Waits for execute() to return and rethrows its exception */
 	inline void join() {
-		if (thread.joinable()) thread.join();
+		if (task.valid()) task.get();
+	}
+
+	/* Waits for execute() to return, without consuming the result like join() */
+	inline void wait() const {
+		if (task.valid()) task.wait();
 	}
 
 	inline size_t getPhotonsRemaining() const {
@@ -43,15 +308,67 @@ public:
 		return photonNum;
 	}
 
+	/* True once execute() returned, also when it was cancelled */
 	inline bool isDone() const {
-		return photonsRemaining == 0;
+		return task.valid() && task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 	}
 
 	inline void sourceRandom(std::random_device& device) {
 		randomSource = std::mt19937(device());
 	}
 
-	renderWorker_t(const space_t& space, size_t photonNum, size_t width, size_t height);
+	inline void seedRandom(std::mt19937::result_type seed) {
+		randomSource = std::mt19937(seed);
+	}
+
+	/* Must be called before the thread is started */
+	inline void setHeatmapMode(heatmapMode_e mode) {
+		heatmapMode = mode;
+	}
+
+	/* Draws the photons of every layer of the space apart, must be called before the thread is started */
+	inline void setLayered(bool value) {
+		layerCount = value ? space.layerNames.size() : 0;
+	}
+
+	/* Draws only the region of the space into the pixels, must be called before the thread is started */
+	inline void setRegion(const region_t& value) {
+		region = value;
+	}
+
+	/* Must be called before the thread is started */
+	inline void setDetectorOnly(bool value) {
+		detectorOnly = value;
+	}
+
+	/* Draws into the tiled image instead of the pixels, which are not allocated. Must be called before the thread is started */
+	inline void setTiledImage(std::shared_ptr<tiledImage_t> image) {
+		tiledImage = std::move(image);
+	}
+
+	/* Adds the buffers to the reduction as the worker with the index when it returns, must be called before the thread is started */
+	inline void setReduction(std::shared_ptr<reduction_t> value, size_t workerIndex) {
+		reduction = std::move(value);
+		index = workerIndex;
+	}
+
+	/* Sorts the photons every interval steps, zero to not sort them. Must be called before the thread is started */
+	inline void setSortInterval(size_t value) {
+		sortInterval = value;
+	}
+
+	/* Records the paths of the photons into the writer, must be called before the thread is started */
+	inline void setPathWriter(std::shared_ptr<pathWriter_t> writer) {
+		if (writer) recorder.emplace(std::move(writer));
+		else recorder.reset();
+	}
+
+	/* Only safe to call after the worker has finished */
+	inline const renderStats_t& getStats() const {
+		return stats;
+	}
+
+	renderWorker_t(spaceSnapshot_t space, size_t photonNum, size_t width, size_t height);
 };
 
 class batchController_t {
@@ -60,26 +377,184 @@ protected:
 	size_t width = 0;
 	size_t height = 0;
 	std::vector<color_t> pixels;
+	/* Pixel buffers of merged workers, handed to the workers of the next render so renders started one after another do not allocate them again */
+	std::vector<std::vector<color_t>> spareBuffers;
+	/* Adds up the buffers of the running render off the event loop, the image changes when all workers are merged */
+	std::shared_ptr<reduction_t> reduction;
+	/* Photons of the workers that returned, added to the accumulated photons with their pixels */
+	size_t photonsPending = 0;
 	bool pixelsDirty = false;
 	/* Used to calculate the percentage of photons done */
 	size_t initialWorkerNum = 0;
 	sdlhelp::unique_surface_ptr cacheSurface;
 	extent_t multiplier = 0.01;
+	/* Photons merged into the image since it was last cleared */
+	size_t photonsAccumulated = 0;
+	/* When not zero the image is shown as if this amount of photons was merged, so an image that keeps accumulating keeps its brightness */
+	size_t exposurePhotons = 0;
+	/* Statistics of the finished workers of the last render */
+	renderStats_t stats;
+	std::chrono::steady_clock::time_point renderStart;
+	/* The mode used for the following renders */
+	heatmapMode_e heatmapMode = heatmapMode_e::off;
+	/* March cost per pixel, empty if no render collected it since the last clear */
+	std::vector<uint64_t> cost;
+	bool showHeatmap = false;
+	/* When set the following renders draw every layer of the space apart and the image is recombined from the layers */
+	bool layered = false;
+	/* When set the following renders only measure the detectors and leave the image as it is */
+	bool detectorOnly = false;
+	/* The part of the space the image shows, the whole space when not set */
+	std::optional<region_t> region;
+	/* The workers of the following renders sort their photons by position every this many steps, zero to not sort them */
+	size_t sortInterval = 0;
+
+	/* The accumulated layers, empty when the image is not made of layers */
+	std::vector<std::vector<color_t>> layers;
+	/* The layer names of the space the layers belong to, the layers start over when a space with other layers is rendered */
+	std::vector<std::string> layerNames;
+	/* The colour and weight each layer is recombined with */
+	std::vector<layerLight_t> layerLights;
+	/* The photon paths of the following renders are recorded to this file, if not empty */
+	std::filesystem::path recordPath;
+	/* The recording of the photons in the image, opened by the first render after the image was cleared */
+	std::shared_ptr<pathWriter_t> pathWriter;
+	/* When not empty the image is accumulated in a tiled image in this file instead of the pixels */
+	std::filesystem::path tiledPath;
+	/* The image of the size, when tiled */
+	std::shared_ptr<tiledImage_t> tiledImage;
+
+	/* A replay drawn on a background thread, the image is only replaced by pollReplay() */
+	struct replayJob_t {
+		std::thread thread;
+		std::atomic<bool> done = false;
+		std::atomic<bool> cancelled = false;
+		spaceSnapshot_t space;
+		size_t width = 0;
+		size_t height = 0;
+		bool layered = false;
+		std::vector<std::vector<color_t>> targets;
+		pathReplay_t result;
+		/* Set if replayPaths() threw */
+		std::exception_ptr error;
+	};
+	std::unique_ptr<replayJob_t> replayJob;
+
+	/* Stops the replay after its current chunks and discards it */
+	void cancelReplay();
+
+	/* Makes the pixels the sum of the layers multiplied by their colours */
+	void recombine();
+	/* Makes the layers the ones of the space, each lit by the colour of its first spawner */
+	void resetLayers(const space_t& space);
+	/* Stops the render and clears the pixels, the layers and the march cost, without starting a new recording */
+	void clearImage();
+	/* Takes a buffer of the size of the image from the spare buffers, or allocates it */
+	std::vector<color_t> takeBuffer();
 
 public:
-	void startRendering(const space_t& space, size_t photonNum, size_t threadCount = 4);
+	/* Starts the workers, they share the snapshot. If a seed is specified worker i is seeded with seed + i, so the render can be repeated */
+	void startRendering(spaceSnapshot_t space, size_t photonNum, size_t threadCount = 4, std::optional<std::mt19937::result_type> seed = std::nullopt);
 	bool isDone();
+	/* Stops the workers after their current step and waits for them, the photons simulated so far stay in the image. A running replay is discarded. Returns false if nothing was rendering */
+	bool cancel();
 	/* Returns the percentage of photons simulated */
 	double update();
 	inline bool arePixelsDirty() { return pixelsDirty; };
 	void drawPreview(SDL_Surface* surface, const SDL_Rect& rect, double zoom);
 	sdlhelp::unique_surface_ptr draw(int w, int h);
+	/* Draws the march cost in false colour over the image, on a logarithmic scale relative to the most expensive pixel. The more expensive a pixel, the less of the image shows through */
+	sdlhelp::unique_surface_ptr drawHeatmap(int w, int h);
+	/* Copies the current image, the returned source can be used from other threads */
+	imageSource_t snapshot() const;
+	/* Copies the march cost as a false colour image, the width of the source is zero when there is no cost data */
+	imageSource_t snapshotHeatmap() const;
+	inline void setHeatmapMode(heatmapMode_e mode) { heatmapMode = mode; }
+	inline heatmapMode_e getHeatmapMode() const { return heatmapMode; }
+	inline bool hasHeatmap() const { return !cost.empty(); }
+	inline void setShowHeatmap(bool value) {
+		showHeatmap = value;
+		pixelsDirty = true;
+	}
+	inline bool isShowingHeatmap() const { return showHeatmap; }
 	inline void setMultiplier(extent_t value) {
 		multiplier = value;
 		pixelsDirty = true;
 	};
 	inline extent_t getMultiplier() { return multiplier; }
+	inline void setExposurePhotons(size_t value) {
+		exposurePhotons = value;
+		pixelsDirty = true;
+	}
+	/* The multiplier used for tonemapping, the exposure photons included */
+	inline extent_t getExposure() const {
+		if (exposurePhotons == 0 || photonsAccumulated == 0) return multiplier;
+		return multiplier * (extent_t)exposurePhotons / (extent_t)photonsAccumulated;
+	}
+	/* Returns the statistics of the workers that finished, the render is complete when isDone() */
+	inline const renderStats_t& getStats() const { return stats; }
+	/* Used by the following renders. Switching starts a new image, as the pixels and the layers cannot be mixed */
+	inline void setLayered(bool value) { layered = value; }
+	inline bool isLayered() const { return layered; }
+	/* Used by the following renders, the readings of the detectors are in the statistics */
+	inline void setDetectorOnly(bool value) { detectorOnly = value; }
+	inline bool isDetectorOnly() const { return detectorOnly; }
+	/* Used by the following renders, see renderWorker_t::sortPhotons(). Only the order the photons are simulated in changes, rough shapes then scatter them with other random numbers */
+	inline void setSortInterval(size_t value) { sortInterval = value; }
+	inline size_t getSortInterval() const { return sortInterval; }
+	/*
+		Makes the following renders draw only the region of the space, the photons are still traced
+		through the whole space. The image should be resized for the region, nullopt draws the whole space
+	*/
+	inline void setRegion(const std::optional<region_t>& value) { region = value; }
+	inline const std::optional<region_t>& getRegion() const { return region; }
+	/* The region, or the whole space when no region is set */
+	inline region_t getRegion(const space_t& space) const {
+		return region.value_or(region_t{ vec2_t(0, 0), space.size });
+	}
+	/*
+		Makes the image a tiled image stored in a file named after the path, see tiledImage.h, so its
+		size is only limited by the disk. The image starts over. Tiled images have no layers and no
+		heatmap and cannot be replayed into. An empty path keeps the image in memory again. Throws
+		except::fileOpenFail_ex if the file cannot be created, resize() and clearImage() too when the
+		image is tiled
+	*/
+	void setTiledPath(const std::filesystem::path& path);
+	inline const std::filesystem::path& getTiledPath() const { return tiledPath; }
+	inline bool isTiled() const { return !tiledPath.empty(); }
+	/* Empty until a render with layers started */
+	inline const std::vector<std::string>& getLayerNames() const { return layerNames; }
+	inline const std::vector<layerLight_t>& getLayerLights() const { return layerLights; }
+	/* Changes how the layer is lit and recombines the image, without rendering anything */
+	void setLayerLight(size_t layer, const layerLight_t& light);
+
+	/* Records the paths of the photons of the following renders to the file, see pathLog.h. The recording starts over whenever the image is cleared, an empty path stops recording */
+	void setRecordPath(const std::filesystem::path& path);
+	inline const std::filesystem::path& getRecordPath() const { return recordPath; }
+	/* True if the photons of the image were recorded */
+	inline bool hasRecording() const { return pathWriter != nullptr; }
+	/*
+		Starts drawing the recorded paths on a background thread, at the size with the reflectivities
+		of the space, see pollReplay(). A running render or replay is cancelled first. Throws
+		std::runtime_error if nothing was recorded since the image was cleared or the image is tiled
+	*/
+	void startReplay(spaceSnapshot_t space, size_t width, size_t height);
+	/* Starts drawing the paths of the file, which is not the recording of the image */
+	void startReplay(const std::filesystem::path& path, spaceSnapshot_t space, size_t width, size_t height);
+	/*
+		Replaces the image with the finished replay and returns its statistics. The space must have the
+		shapes and spawners of the recorded one, the exceptions of replayPaths() are rethrown
+	*/
+	std::optional<pathReplay_t> pollReplay();
+	inline bool isReplaying() const { return replayJob != nullptr; }
 
+	inline size_t getWidth() const { return width; }
+	inline size_t getHeight() const { return height; }
 	void resize(size_t width, size_t height);
+	/* Clears the image and starts a new recording */
 	void clear();
+
+	inline ~batchController_t() {
+		cancel();
+	}
 };
\ No newline at end of file
@@ -0,0 +1,673 @@
+#include "pch.h"
+#include "space.h"
+#include "mappedFile.h"
+#include "exceptions.h"
+
+/*
+	Binary scene format (.lsb), made for big scenes that take too long to parse as json.
+	The file is a header followed by tightly packed arrays of fixed size records, all numbers
+	are stored in the native byte order. The file is mapped into memory and the records are
+	copied into the space in one pass, with no parsing.
+*/
+
+namespace {
+	constexpr char MAGIC[4] = { 'L', 'S', 'B', '1' };
+	/* Version 2 added shapes and instances, version 3 circles, arcs and Bézier curves, version 4 polygons, version 5 animations, version 6 light groups, version 7 detectors. Older files are still read */
+	constexpr uint32_t VERSION = 7;
+
+	struct header_t {
+		char magic[4];
+		uint32_t version;
+		double size[2];
+		uint64_t lineCount;
+		uint64_t lineOffset;
+		uint64_t spawnerCount;
+		uint64_t spawnerOffset;
+		/// Version 2
+		uint64_t shapeCount;
+		uint64_t shapeOffset;
+		uint64_t segmentCount;
+		uint64_t segmentOffset;
+		uint64_t instanceCount;
+		uint64_t instanceOffset;
+		/* The shape names, not null terminated */
+		uint64_t namesSize;
+		uint64_t namesOffset;
+		/// Version 3
+		uint64_t circleCount;
+		uint64_t circleOffset;
+		uint64_t arcCount;
+		uint64_t arcOffset;
+		uint64_t bezierCount;
+		uint64_t bezierOffset;
+		/// Version 4
+		uint64_t polygonCount;
+		uint64_t polygonOffset;
+		uint64_t vertexCount;
+		uint64_t vertexOffset;
+		/// Version 5
+		uint64_t animationFrames;
+		uint64_t trackCount;
+		uint64_t trackOffset;
+		uint64_t keyCount;
+		uint64_t keyOffset;
+		/// Version 6
+		uint64_t groupCount;
+		uint64_t groupOffset;
+		/// Version 7
+		uint64_t detectorCount;
+		uint64_t detectorOffset;
+	};
+
+	/* The size of the header in each version, the fields of later versions are zero in older files */
+	constexpr size_t HEADER_SIZES[] = { 0, 56, 120, 168, 200, 240, 256, 272 };
+
+	struct lineRecord_t {
+		double a[2];
+		double b[2];
+		double reflectivity[3];
+		double roughness;
+	};
+
+	struct spawnerRecord_t {
+		uint32_t type;
+		/* The index of the light group plus one, zero if the spawner is in no group */
+		uint32_t group;
+		double size[2];
+		double pos[2];
+		double color[3];
+		double ratio;
+		double direction[2];
+		double spread;
+	};
+
+	/* The segments of a shape are stored one after another in the segment array */
+	struct shapeRecord_t {
+		uint64_t firstSegment;
+		uint64_t segmentCount;
+		uint64_t nameOffset;
+		uint64_t nameSize;
+	};
+
+	/* The name of a light group, in the names array like the shape names */
+	struct groupRecord_t {
+		uint64_t nameOffset;
+		uint64_t nameSize;
+	};
+
+	/* The name is in the names array like the shape names */
+	struct detectorRecord_t {
+		double a[2];
+		double b[2];
+		uint64_t bins;
+		uint64_t nameOffset;
+		uint64_t nameSize;
+	};
+
+	struct segmentRecord_t {
+		double a[2];
+		double b[2];
+	};
+
+	struct instanceRecord_t {
+		uint64_t shape;
+		double translation[2];
+		double rotation;
+		double scale;
+		double reflectivity[3];
+		double roughness;
+	};
+
+	/* Angles are stored in radians */
+	struct circleRecord_t {
+		double center[2];
+		double radius;
+		double reflectivity[3];
+		double roughness;
+	};
+
+	struct arcRecord_t {
+		double center[2];
+		double radius;
+		double start;
+		double end;
+		double reflectivity[3];
+		double roughness;
+	};
+
+	struct bezierRecord_t {
+		double a[2];
+		double control[2];
+		double b[2];
+		double reflectivity[3];
+		double roughness;
+	};
+
+	/* The vertices of a polygon are stored one after another in the vertex array */
+	struct polygonRecord_t {
+		uint32_t closed;
+		uint32_t reserved;
+		uint64_t firstVertex;
+		uint64_t vertexCount;
+		double reflectivity[3];
+		double roughness;
+	};
+
+	struct vertexRecord_t {
+		double position[2];
+	};
+
+	/* The keys of a track are stored one after another in the key array, polygon tracks index the polygon array */
+	struct trackRecord_t {
+		uint32_t target;
+		uint32_t reserved;
+		uint64_t index;
+		uint64_t firstKey;
+		uint64_t keyCount;
+	};
+
+	/* The rotation is stored in radians */
+	struct keyRecord_t {
+		uint64_t frame;
+		double position[2];
+		double rotation;
+		double scale;
+	};
+
+	static_assert(sizeof(header_t) == HEADER_SIZES[VERSION], "Scene header must be packed");
+	static_assert(sizeof(groupRecord_t) == 16, "Group record must be packed");
+	static_assert(sizeof(detectorRecord_t) == 56, "Detector record must be packed");
+	static_assert(sizeof(trackRecord_t) == 32, "Track record must be packed");
+	static_assert(sizeof(keyRecord_t) == 40, "Key record must be packed");
+	static_assert(sizeof(polygonRecord_t) == 56, "Polygon record must be packed");
+	static_assert(sizeof(vertexRecord_t) == 16, "Vertex record must be packed");
+	static_assert(sizeof(circleRecord_t) == 56, "Circle record must be packed");
+	static_assert(sizeof(arcRecord_t) == 72, "Arc record must be packed");
+	static_assert(sizeof(bezierRecord_t) == 80, "Bezier record must be packed");
+	static_assert(sizeof(shapeRecord_t) == 32, "Shape record must be packed");
+	static_assert(sizeof(segmentRecord_t) == 32, "Segment record must be packed");
+	static_assert(sizeof(instanceRecord_t) == 72, "Instance record must be packed");
+	static_assert(sizeof(lineRecord_t) == 64, "Line record must be packed");
+	static_assert(sizeof(spawnerRecord_t) == 96, "Spawner record must be packed");
+	static_assert(std::is_same_v<extent_t, double>, "Records store extent_t as double");
+
+	/* Checks that count records at offset fit in the file */
+	bool fits(uint64_t offset, uint64_t count, size_t recordSize, size_t fileSize) {
+		if (offset > fileSize) return false;
+		return count <= (fileSize - offset) / recordSize;
+	}
+}
+
+void space_t::loadFromBinary(const std::filesystem::path& path) {
+	mappedFile_t file;
+	file.open(path);
+
+	auto invalid = [&](const std::string& reason) {
+		return except::config_ex("Invalid scene file " + std::filesystem::absolute(path).string() + ", " + reason);
+	};
+
+	if (file.getSize() < HEADER_SIZES[1]) throw invalid("file too short");
+	header_t header = {};
+	std::memcpy(&header, file.getData(), HEADER_SIZES[1]);
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) throw invalid("not a binary scene");
+	if (header.version == 0 || header.version > VERSION) throw invalid("unsupported version " + std::to_string(header.version));
+	auto headerSize = HEADER_SIZES[header.version];
+	if (file.getSize() < headerSize) throw invalid("file too short");
+	std::memcpy(&header, file.getData(), headerSize);
+	if (!fits(header.lineOffset, header.lineCount, sizeof(lineRecord_t), file.getSize())) throw invalid("lines out of bounds");
+	if (!fits(header.spawnerOffset, header.spawnerCount, sizeof(spawnerRecord_t), file.getSize())) throw invalid("spawners out of bounds");
+	if (!fits(header.shapeOffset, header.shapeCount, sizeof(shapeRecord_t), file.getSize())) throw invalid("shapes out of bounds");
+	if (!fits(header.segmentOffset, header.segmentCount, sizeof(segmentRecord_t), file.getSize())) throw invalid("segments out of bounds");
+	if (!fits(header.instanceOffset, header.instanceCount, sizeof(instanceRecord_t), file.getSize())) throw invalid("instances out of bounds");
+	if (!fits(header.namesOffset, header.namesSize, 1, file.getSize())) throw invalid("names out of bounds");
+	if (!fits(header.circleOffset, header.circleCount, sizeof(circleRecord_t), file.getSize())) throw invalid("circles out of bounds");
+	if (!fits(header.arcOffset, header.arcCount, sizeof(arcRecord_t), file.getSize())) throw invalid("arcs out of bounds");
+	if (!fits(header.bezierOffset, header.bezierCount, sizeof(bezierRecord_t), file.getSize())) throw invalid("Bézier curves out of bounds");
+	if (!fits(header.polygonOffset, header.polygonCount, sizeof(polygonRecord_t), file.getSize())) throw invalid("polygons out of bounds");
+	if (!fits(header.vertexOffset, header.vertexCount, sizeof(vertexRecord_t), file.getSize())) throw invalid("vertices out of bounds");
+	if (!fits(header.trackOffset, header.trackCount, sizeof(trackRecord_t), file.getSize())) throw invalid("tracks out of bounds");
+	if (!fits(header.keyOffset, header.keyCount, sizeof(keyRecord_t), file.getSize())) throw invalid("keys out of bounds");
+	if (!fits(header.groupOffset, header.groupCount, sizeof(groupRecord_t), file.getSize())) throw invalid("groups out of bounds");
+	if (!fits(header.detectorOffset, header.detectorCount, sizeof(detectorRecord_t), file.getSize())) throw invalid("detectors out of bounds");
+
+	clear();
+	spawners.clear();
+	size = vec2_t(header.size[0], header.size[1]);
+
+	// line_t has a vtable, so the records cannot be used in place and are copied out instead
+	{
+		auto& lines = objectHolder_t<line_t>::items;
+		lines.resize((size_t)header.lineCount);
+		auto records = file.getData() + header.lineOffset;
+		for (size_t i = 0, len = lines.size(); i < len; i++) {
+			lineRecord_t record;
+			std::memcpy(&record, records + i * sizeof(lineRecord_t), sizeof(lineRecord_t));
+			auto& line = lines[i];
+			line.a = vec2_t(record.a[0], record.a[1]);
+			line.b = vec2_t(record.b[0], record.b[1]);
+			line.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			line.roughness = record.roughness;
+		}
+	}
+
+	{
+		std::vector<std::string> groups((size_t)header.groupCount);
+		auto groupRecords = file.getData() + header.groupOffset;
+		auto names = (const char*)file.getData() + header.namesOffset;
+		for (size_t i = 0, len = groups.size(); i < len; i++) {
+			groupRecord_t record;
+			std::memcpy(&record, groupRecords + i * sizeof(groupRecord_t), sizeof(groupRecord_t));
+			if (record.nameOffset > header.namesSize || record.nameSize > header.namesSize - record.nameOffset) throw invalid("group name out of bounds");
+			groups[i].assign(names + record.nameOffset, (size_t)record.nameSize);
+		}
+
+		spawners.resize((size_t)header.spawnerCount);
+		auto records = file.getData() + header.spawnerOffset;
+		for (size_t i = 0, len = spawners.size(); i < len; i++) {
+			spawnerRecord_t record;
+			std::memcpy(&record, records + i * sizeof(spawnerRecord_t), sizeof(spawnerRecord_t));
+			auto& spawner = spawners[i];
+			if (record.type > (uint32_t)spawner_t::type_e::line) throw invalid("unknown spawner type " + std::to_string(record.type));
+			spawner.type = (spawner_t::type_e)record.type;
+			spawner.size = vec2_t(record.size[0], record.size[1]);
+			spawner.pos = vec2_t(record.pos[0], record.pos[1]);
+			spawner.color = color_t(record.color[0], record.color[1], record.color[2]);
+			spawner.ratio = record.ratio;
+			spawner.direction = vec2_t(record.direction[0], record.direction[1]);
+			spawner.spread = record.spread;
+			if (record.group > groups.size()) throw invalid("spawner in unknown group " + std::to_string(record.group));
+			if (record.group != 0) spawner.group = groups[record.group - 1];
+		}
+	}
+
+	{
+		auto shapeRecords = file.getData() + header.shapeOffset;
+		auto segmentRecords = file.getData() + header.segmentOffset;
+		auto names = (const char*)file.getData() + header.namesOffset;
+		definitions.reserve((size_t)header.shapeCount);
+		for (size_t i = 0; i < header.shapeCount; i++) {
+			shapeRecord_t record;
+			std::memcpy(&record, shapeRecords + i * sizeof(shapeRecord_t), sizeof(shapeRecord_t));
+			if (record.firstSegment > header.segmentCount || record.segmentCount > header.segmentCount - record.firstSegment) throw invalid("shape segments out of bounds");
+			if (record.nameOffset > header.namesSize || record.nameSize > header.namesSize - record.nameOffset) throw invalid("shape name out of bounds");
+
+			auto& definition = *definitions.emplace_back(std::make_shared<shapeDefinition_t>());
+			definition.name.assign(names + record.nameOffset, (size_t)record.nameSize);
+			definition.items.resize((size_t)record.segmentCount);
+			for (size_t j = 0, len = definition.items.size(); j < len; j++) {
+				segmentRecord_t segment;
+				std::memcpy(&segment, segmentRecords + (record.firstSegment + j) * sizeof(segmentRecord_t), sizeof(segmentRecord_t));
+				definition.items[j].a = vec2_t(segment.a[0], segment.a[1]);
+				definition.items[j].b = vec2_t(segment.b[0], segment.b[1]);
+			}
+			definition.update();
+		}
+	}
+
+	{
+		auto& instances = objectHolder_t<instance_t>::items;
+		instances.resize((size_t)header.instanceCount);
+		auto records = file.getData() + header.instanceOffset;
+		for (size_t i = 0, len = instances.size(); i < len; i++) {
+			instanceRecord_t record;
+			std::memcpy(&record, records + i * sizeof(instanceRecord_t), sizeof(instanceRecord_t));
+			if (record.shape >= definitions.size()) throw invalid("instance of unknown shape " + std::to_string(record.shape));
+			if (!(record.scale > 0)) throw invalid("instance scale must be greater than zero");
+			auto& instance = instances[i];
+			instance.definition = definitions[(size_t)record.shape];
+			instance.transform.translation = vec2_t(record.translation[0], record.translation[1]);
+			instance.transform.rotation = record.rotation;
+			instance.transform.scale = record.scale;
+			instance.transform.update();
+			instance.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			instance.roughness = record.roughness;
+		}
+	}
+
+	{
+		auto& circles = objectHolder_t<circle_t>::items;
+		circles.resize((size_t)header.circleCount);
+		auto records = file.getData() + header.circleOffset;
+		for (size_t i = 0, len = circles.size(); i < len; i++) {
+			circleRecord_t record;
+			std::memcpy(&record, records + i * sizeof(circleRecord_t), sizeof(circleRecord_t));
+			auto& circle = circles[i];
+			circle.center = vec2_t(record.center[0], record.center[1]);
+			circle.radius = record.radius;
+			circle.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			circle.roughness = record.roughness;
+		}
+	}
+
+	{
+		auto& arcs = objectHolder_t<arc_t>::items;
+		arcs.resize((size_t)header.arcCount);
+		auto records = file.getData() + header.arcOffset;
+		for (size_t i = 0, len = arcs.size(); i < len; i++) {
+			arcRecord_t record;
+			std::memcpy(&record, records + i * sizeof(arcRecord_t), sizeof(arcRecord_t));
+			auto& arc = arcs[i];
+			arc.center = vec2_t(record.center[0], record.center[1]);
+			arc.radius = record.radius;
+			arc.start = record.start;
+			arc.end = record.end;
+			arc.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			arc.roughness = record.roughness;
+			arc.update();
+		}
+	}
+
+	{
+		auto& beziers = objectHolder_t<bezier_t>::items;
+		beziers.resize((size_t)header.bezierCount);
+		auto records = file.getData() + header.bezierOffset;
+		for (size_t i = 0, len = beziers.size(); i < len; i++) {
+			bezierRecord_t record;
+			std::memcpy(&record, records + i * sizeof(bezierRecord_t), sizeof(bezierRecord_t));
+			auto& bezier = beziers[i];
+			bezier.a = vec2_t(record.a[0], record.a[1]);
+			bezier.control = vec2_t(record.control[0], record.control[1]);
+			bezier.b = vec2_t(record.b[0], record.b[1]);
+			bezier.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			bezier.roughness = record.roughness;
+		}
+	}
+
+	{
+		auto& polygons = objectHolder_t<polygon_t>::items;
+		polygons.resize((size_t)header.polygonCount);
+		auto records = file.getData() + header.polygonOffset;
+		auto vertices = file.getData() + header.vertexOffset;
+		for (size_t i = 0, len = polygons.size(); i < len; i++) {
+			polygonRecord_t record;
+			std::memcpy(&record, records + i * sizeof(polygonRecord_t), sizeof(polygonRecord_t));
+			if (record.firstVertex > header.vertexCount || record.vertexCount > header.vertexCount - record.firstVertex) throw invalid("polygon vertices out of bounds");
+			auto& polygon = polygons[i];
+			polygon.closed = record.closed != 0;
+			polygon.vertices.resize((size_t)record.vertexCount);
+			static_assert(sizeof(vec2_t) == sizeof(vertexRecord_t), "Vertices are copied as a block");
+			std::memcpy(polygon.vertices.data(), vertices + record.firstVertex * sizeof(vertexRecord_t), polygon.vertices.size() * sizeof(vertexRecord_t));
+			polygon.reflectivity = color_t(record.reflectivity[0], record.reflectivity[1], record.reflectivity[2]);
+			polygon.roughness = record.roughness;
+			polygon.update();
+		}
+	}
+
+	{
+		animation.frames = (size_t)header.animationFrames;
+		auto& tracks = animation.tracks;
+		tracks.resize((size_t)header.trackCount);
+		auto records = file.getData() + header.trackOffset;
+		auto keys = file.getData() + header.keyOffset;
+		for (size_t i = 0, len = tracks.size(); i < len; i++) {
+			trackRecord_t record;
+			std::memcpy(&record, records + i * sizeof(trackRecord_t), sizeof(trackRecord_t));
+			if (record.target > (uint32_t)track_t::target_e::polygon) throw invalid("unknown track target " + std::to_string(record.target));
+			if (record.firstKey > header.keyCount || record.keyCount > header.keyCount - record.firstKey) throw invalid("track keys out of bounds");
+			if (record.keyCount == 0) throw invalid("track without keys");
+			auto& track = tracks[i];
+			track.target = (track_t::target_e)record.target;
+			track.index = (size_t)record.index;
+			size_t count = track.target == track_t::target_e::spawner ? spawners.size()
+				: track.target == track_t::target_e::instance ? objectHolder_t<instance_t>::items.size()
+				: objectHolder_t<polygon_t>::items.size();
+			if (record.index >= count) throw invalid("track of unknown object " + std::to_string(record.index));
+
+			track.keys.resize((size_t)record.keyCount);
+			for (size_t j = 0, keyCount = track.keys.size(); j < keyCount; j++) {
+				keyRecord_t key;
+				std::memcpy(&key, keys + (record.firstKey + j) * sizeof(keyRecord_t), sizeof(keyRecord_t));
+				if (!(key.scale > 0)) throw invalid("key scale must be greater than zero");
+				if (j != 0 && key.frame < track.keys[j - 1].frame) throw invalid("track keys out of order");
+				track.keys[j] = keyframe_t{ (size_t)key.frame, vec2_t(key.position[0], key.position[1]), key.rotation, key.scale };
+			}
+		}
+	}
+
+	{
+		detectors.resize((size_t)header.detectorCount);
+		auto records = file.getData() + header.detectorOffset;
+		auto names = (const char*)file.getData() + header.namesOffset;
+		for (size_t i = 0, len = detectors.size(); i < len; i++) {
+			detectorRecord_t record;
+			std::memcpy(&record, records + i * sizeof(detectorRecord_t), sizeof(detectorRecord_t));
+			if (record.nameOffset > header.namesSize || record.nameSize > header.namesSize - record.nameOffset) throw invalid("detector name out of bounds");
+			auto& detector = detectors[i];
+			detector.a = vec2_t(record.a[0], record.a[1]);
+			detector.b = vec2_t(record.b[0], record.b[1]);
+			if (detector.a == detector.b) throw invalid("detector without length");
+			detector.bins = (size_t)record.bins;
+			detector.name.assign(names + record.nameOffset, (size_t)record.nameSize);
+		}
+	}
+
+	normalizeSpawners();
+}
+
+void space_t::saveToBinary(const std::filesystem::path& path) const {
+	std::ofstream file;
+	file.open(path, std::ios::binary);
+
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	auto& lines = objectHolder_t<line_t>::items;
+	auto& instances = objectHolder_t<instance_t>::items;
+	auto& circles = objectHolder_t<circle_t>::items;
+	auto& arcs = objectHolder_t<arc_t>::items;
+	auto& beziers = objectHolder_t<bezier_t>::items;
+	auto& polygons = objectHolder_t<polygon_t>::items;
+
+	std::vector<shapeRecord_t> shapeRecords;
+	std::vector<segmentRecord_t> segmentRecords;
+	std::string names;
+	std::unordered_map<const shapeDefinition_t*, uint64_t> shapeIndices;
+	for (auto& definition : definitions) {
+		shapeIndices[definition.get()] = shapeRecords.size();
+		shapeRecords.push_back(shapeRecord_t{ segmentRecords.size(), definition->items.size(), names.size(), definition->name.size() });
+		names += definition->name;
+		for (auto& line : definition->items) {
+			segmentRecords.push_back(segmentRecord_t{ { line.a.x, line.a.y }, { line.b.x, line.b.y } });
+		}
+	}
+
+	std::vector<groupRecord_t> groupRecords;
+	std::vector<uint32_t> spawnerGroups(spawners.size(), 0);
+	std::unordered_map<std::string, uint32_t> groupIndices;
+	for (size_t i = 0, len = spawners.size(); i < len; i++) {
+		auto& group = spawners[i].group;
+		if (group.empty()) continue;
+		auto [iter, added] = groupIndices.emplace(group, (uint32_t)groupRecords.size() + 1);
+		if (added) {
+			groupRecords.push_back(groupRecord_t{ names.size(), group.size() });
+			names += group;
+		}
+		spawnerGroups[i] = iter->second;
+	}
+
+	std::vector<detectorRecord_t> detectorRecords;
+	for (auto& detector : detectors) {
+		detectorRecords.push_back(detectorRecord_t{ { detector.a.x, detector.a.y }, { detector.b.x, detector.b.y }, detector.bins, names.size(), detector.name.size() });
+		names += detector.name;
+	}
+
+	header_t header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.size[0] = size.x;
+	header.size[1] = size.y;
+	header.lineCount = lines.size();
+	header.lineOffset = sizeof(header_t);
+	header.spawnerCount = spawners.size();
+	header.spawnerOffset = header.lineOffset + header.lineCount * sizeof(lineRecord_t);
+	header.shapeCount = shapeRecords.size();
+	header.shapeOffset = header.spawnerOffset + header.spawnerCount * sizeof(spawnerRecord_t);
+	header.segmentCount = segmentRecords.size();
+	header.segmentOffset = header.shapeOffset + header.shapeCount * sizeof(shapeRecord_t);
+	header.instanceCount = instances.size();
+	header.instanceOffset = header.segmentOffset + header.segmentCount * sizeof(segmentRecord_t);
+	header.namesSize = names.size();
+	header.namesOffset = header.instanceOffset + header.instanceCount * sizeof(instanceRecord_t);
+	header.circleCount = circles.size();
+	header.circleOffset = header.namesOffset + header.namesSize;
+	header.arcCount = arcs.size();
+	header.arcOffset = header.circleOffset + header.circleCount * sizeof(circleRecord_t);
+	header.bezierCount = beziers.size();
+	header.bezierOffset = header.arcOffset + header.arcCount * sizeof(arcRecord_t);
+	header.polygonCount = polygons.size();
+	header.polygonOffset = header.bezierOffset + header.bezierCount * sizeof(bezierRecord_t);
+	header.vertexCount = std::accumulate(polygons.begin(), polygons.end(), (uint64_t)0, [](uint64_t value, const polygon_t& polygon) {
+		return value + polygon.vertices.size();
+	});
+	header.vertexOffset = header.polygonOffset + header.polygonCount * sizeof(polygonRecord_t);
+	header.animationFrames = animation.frames;
+	header.trackCount = animation.tracks.size();
+	header.trackOffset = header.vertexOffset + header.vertexCount * sizeof(vertexRecord_t);
+	header.keyCount = std::accumulate(animation.tracks.begin(), animation.tracks.end(), (uint64_t)0, [](uint64_t value, const track_t& track) {
+		return value + track.keys.size();
+	});
+	header.keyOffset = header.trackOffset + header.trackCount * sizeof(trackRecord_t);
+	header.groupCount = groupRecords.size();
+	header.groupOffset = header.keyOffset + header.keyCount * sizeof(keyRecord_t);
+	header.detectorCount = detectorRecords.size();
+	header.detectorOffset = header.groupOffset + header.groupCount * sizeof(groupRecord_t);
+	file.write((const char*)&header, sizeof(header));
+
+	{
+		std::vector<lineRecord_t> records(lines.size());
+		for (size_t i = 0, len = lines.size(); i < len; i++) {
+			auto& line = lines[i];
+			records[i] = lineRecord_t{
+				{ line.a.x, line.a.y },
+				{ line.b.x, line.b.y },
+				{ line.reflectivity.r, line.reflectivity.g, line.reflectivity.b },
+				line.roughness
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(lineRecord_t));
+	}
+
+	{
+		std::vector<spawnerRecord_t> records(spawners.size());
+		for (size_t i = 0, len = spawners.size(); i < len; i++) {
+			auto& spawner = spawners[i];
+			records[i] = spawnerRecord_t{
+				(uint32_t)spawner.type, spawnerGroups[i],
+				{ spawner.size.x, spawner.size.y },
+				{ spawner.pos.x, spawner.pos.y },
+				{ spawner.color.r, spawner.color.g, spawner.color.b },
+				spawner.ratio,
+				{ spawner.direction.x, spawner.direction.y },
+				spawner.spread
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(spawnerRecord_t));
+	}
+
+	file.write((const char*)shapeRecords.data(), shapeRecords.size() * sizeof(shapeRecord_t));
+	file.write((const char*)segmentRecords.data(), segmentRecords.size() * sizeof(segmentRecord_t));
+
+	{
+		std::vector<instanceRecord_t> records(instances.size());
+		for (size_t i = 0, len = instances.size(); i < len; i++) {
+			auto& instance = instances[i];
+			records[i] = instanceRecord_t{
+				shapeIndices.at(instance.definition.get()),
+				{ instance.transform.translation.x, instance.transform.translation.y },
+				instance.transform.rotation,
+				instance.transform.scale,
+				{ instance.reflectivity.r, instance.reflectivity.g, instance.reflectivity.b },
+				instance.roughness
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(instanceRecord_t));
+	}
+
+	file.write(names.data(), names.size());
+
+	{
+		std::vector<circleRecord_t> records(circles.size());
+		for (size_t i = 0, len = circles.size(); i < len; i++) {
+			auto& circle = circles[i];
+			records[i] = circleRecord_t{
+				{ circle.center.x, circle.center.y },
+				circle.radius,
+				{ circle.reflectivity.r, circle.reflectivity.g, circle.reflectivity.b },
+				circle.roughness
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(circleRecord_t));
+	}
+
+	{
+		std::vector<arcRecord_t> records(arcs.size());
+		for (size_t i = 0, len = arcs.size(); i < len; i++) {
+			auto& arc = arcs[i];
+			records[i] = arcRecord_t{
+				{ arc.center.x, arc.center.y },
+				arc.radius,
+				arc.start,
+				arc.end,
+				{ arc.reflectivity.r, arc.reflectivity.g, arc.reflectivity.b },
+				arc.roughness
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(arcRecord_t));
+	}
+
+	{
+		std::vector<bezierRecord_t> records(beziers.size());
+		for (size_t i = 0, len = beziers.size(); i < len; i++) {
+			auto& bezier = beziers[i];
+			records[i] = bezierRecord_t{
+				{ bezier.a.x, bezier.a.y },
+				{ bezier.control.x, bezier.control.y },
+				{ bezier.b.x, bezier.b.y },
+				{ bezier.reflectivity.r, bezier.reflectivity.g, bezier.reflectivity.b },
+				bezier.roughness
+			};
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(bezierRecord_t));
+	}
+
+	{
+		std::vector<polygonRecord_t> records(polygons.size());
+		uint64_t firstVertex = 0;
+		for (size_t i = 0, len = polygons.size(); i < len; i++) {
+			auto& polygon = polygons[i];
+			records[i] = polygonRecord_t{
+				polygon.closed ? 1u : 0u, 0,
+				firstVertex,
+				polygon.vertices.size(),
+				{ polygon.reflectivity.r, polygon.reflectivity.g, polygon.reflectivity.b },
+				polygon.roughness
+			};
+			firstVertex += polygon.vertices.size();
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(polygonRecord_t));
+		for (auto& polygon : polygons) {
+			file.write((const char*)polygon.vertices.data(), polygon.vertices.size() * sizeof(vertexRecord_t));
+		}
+	}
+
+	{
+		std::vector<trackRecord_t> records(animation.tracks.size());
+		std::vector<keyRecord_t> keys;
+		keys.reserve((size_t)header.keyCount);
+		for (size_t i = 0, len = animation.tracks.size(); i < len; i++) {
+			auto& track = animation.tracks[i];
+			records[i] = trackRecord_t{ (uint32_t)track.target, 0, track.index, keys.size(), track.keys.size() };
+			for (auto& key : track.keys) {
+				keys.push_back(keyRecord_t{ key.frame, { key.position.x, key.position.y }, key.rotation, key.scale });
+			}
+		}
+		file.write((const char*)records.data(), records.size() * sizeof(trackRecord_t));
+		file.write((const char*)keys.data(), keys.size() * sizeof(keyRecord_t));
+	}
+
+	file.write((const char*)groupRecords.data(), groupRecords.size() * sizeof(groupRecord_t));
+	file.write((const char*)detectorRecords.data(), detectorRecords.size() * sizeof(detectorRecord_t));
+
+	if (file.fail()) throw std::runtime_error("Failed to write file " + std::filesystem::absolute(path).string());
+}
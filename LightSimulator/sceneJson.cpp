@@ -0,0 +1,1003 @@
+#include "pch.h"
+#include "space.h"
+#include "exceptions.h"
+
+/*
+	Streaming json scene loader. The file is read with the nlohmann SAX interface, each object
+	is written straight into the space as its fields arrive, no document is kept in memory.
+	Objects are described by kind_t tables, so new scene properties only need a new field entry.
+	Paths to values are only built when an error is reported.
+*/
+
+namespace {
+	constexpr char
+		VECTOR_TYPE[] = "[x : number, y : number]",
+		COLOR_TYPE[] = "[r : number, g : number, b : number]",
+		NUMBER_TYPE[] = "number",
+		STRING_TYPE[] = "string",
+		OBJECT_TYPE[] = "object";
+	constexpr extent_t DEGREES_TO_RADIANS = 3.14159265358979323846 / 180;
+
+	struct loader_t;
+
+	/* A scalar or a fixed size array of numbers */
+	struct value_t {
+		extent_t numbers[3] = { 0, 0, 0 };
+		size_t count = 0;
+		std::string text;
+		std::vector<vec2_t> points;
+
+		inline vec2_t toVec2() const { return vec2_t(numbers[0], numbers[1]); }
+		inline color_t toColor() const { return color_t(numbers[0], numbers[1], numbers[2]); }
+	};
+
+	struct kind_t;
+
+	struct field_t {
+		enum class type_e {
+			number,
+			vec2,
+			color,
+			string,
+			/* Array of objects described by the items kind */
+			objectArray,
+			/* A single object described by the items kind */
+			object,
+			vec2Array
+		};
+
+		const char* name;
+		type_e type;
+		bool required;
+		/* Stores the value in the record of the object, not used for object arrays */
+		void (*set)(loader_t& loader, void* record, const value_t& value) = nullptr;
+		/* The kind of the objects of object and object array fields */
+		const kind_t* items = nullptr;
+
+		inline std::string getTypeName() const;
+		/* The type of the numbers array of vec2 and color fields, for vec2 arrays the type of one item */
+		inline std::string getValueTypeName() const {
+			return type == type_e::vec2Array ? VECTOR_TYPE : getTypeName();
+		}
+	};
+
+	struct kind_t {
+		/* The name of the type used in error messages */
+		const char* typeName;
+		std::vector<field_t> fields;
+		/* Returns the record the fields of a new object are stored in, parent is the record of the containing object */
+		void* (*begin)(loader_t& loader, void* parent);
+		/* Called after the required fields were checked, may be null */
+		void (*end)(loader_t& loader, void* record) = nullptr;
+	};
+
+	inline std::string field_t::getTypeName() const {
+		switch (type) {
+		case type_e::number: return NUMBER_TYPE;
+		case type_e::vec2: return VECTOR_TYPE;
+		case type_e::color: return COLOR_TYPE;
+		case type_e::string: return STRING_TYPE;
+		case type_e::vec2Array: return VECTOR_TYPE + std::string("[]");
+		case type_e::object: return items->typeName;
+		default: return items->typeName + std::string("[]");
+		}
+	}
+
+	struct frame_t {
+		enum class type_e {
+			object,
+			objectArray,
+			/* Array of numbers of a vec2 or color field, or of one item of a vec2 array */
+			valueArray,
+			/* Array of vectors of a vec2 array field */
+			pointArray,
+			/* Value of an unknown key */
+			skip
+		};
+
+		type_e type;
+		/* For objects the kind of the object, for object arrays the kind of the items */
+		const kind_t* kind = nullptr;
+		/* For objects the field of the current key, for arrays the field the array belongs to */
+		const field_t* field = nullptr;
+		/* For objects the record of the object, for object arrays the record of the containing object */
+		void* record = nullptr;
+		std::string key;
+		/* The index of the current item of arrays */
+		size_t index = 0;
+		/* Bit mask of the fields read, by their index in the kind */
+		uint64_t seen = 0;
+		value_t value;
+		size_t skipDepth = 0;
+	};
+
+	struct loader_t {
+		space_t& space;
+		const kind_t& rootKind;
+		std::vector<frame_t> frames;
+		/* The record of the spawner being read, spawners are not nested so one is enough */
+		struct spawnerRecord_t {
+			spawner_t spawner;
+			std::string type;
+			bool hasPosition = false;
+			bool hasSize = false;
+			bool hasRadius = false;
+			bool hasA = false;
+			bool hasB = false;
+			vec2_t a, b;
+		} spawnerRecord;
+		std::unordered_map<std::string, std::shared_ptr<shapeDefinition_t>> definitionsByName;
+		/* The shape names of the instances, resolved at the end because the shapes may come after the instances */
+		std::vector<std::string> instanceShapes;
+		/* The objects given by each track, resolved at the end because the objects may come after the animation */
+		struct trackRecord_t {
+			/* The amount of target fields given, must be exactly one */
+			size_t targets = 0;
+			/* Polygon indices are counted among the polylines */
+			bool polyline = false;
+		};
+		std::vector<trackRecord_t> trackRecords;
+
+		loader_t(space_t& space, const kind_t& rootKind) : space(space), rootKind(rootKind) {}
+
+		/// Error reporting
+
+		/* Builds the path of the value the frame at the index represents */
+		std::string getPath(size_t index) const {
+			std::string path;
+			for (size_t i = 1; i <= index; i++) {
+				auto& parent = frames[i - 1];
+				if (parent.type == frame_t::type_e::object) {
+					if (!path.empty()) path += ".";
+					path += parent.key;
+				} else {
+					path += "[" + std::to_string(parent.index) + "]";
+				}
+			}
+			return path;
+		}
+
+		/* Path of the current value in the top frame */
+		std::string getValuePath() const {
+			auto& top = frames.back();
+			auto path = getPath(frames.size() - 1);
+			if (top.type == frame_t::type_e::object) {
+				return path.empty() ? top.key : path + "." + top.key;
+			} else if (top.type == frame_t::type_e::objectArray || top.type == frame_t::type_e::pointArray) {
+				return path + "[" + std::to_string(top.index) + "]";
+			}
+			return path;
+		}
+
+		[[noreturn]] void throwMistyped(const std::string& path, const std::string& expected) const {
+			throw except::configValueMistyped_ex(path, expected);
+		}
+
+		/// Helpers
+
+		void markSeen(frame_t& object, const field_t* field) {
+			object.seen |= (uint64_t)1 << (field - object.kind->fields.data());
+		}
+
+		const field_t* findField(const kind_t& kind, const std::string& key) const {
+			for (auto& field : kind.fields) {
+				if (key == field.name) return &field;
+			}
+			return nullptr;
+		}
+
+		/* Handles a value that is not an object or an array */
+		bool scalar(bool isNumber, extent_t number, const std::string* text) {
+			if (frames.empty()) throwMistyped("(root)", OBJECT_TYPE);
+			auto& top = frames.back();
+			switch (top.type) {
+			case frame_t::type_e::skip:
+				break;
+			case frame_t::type_e::object: {
+				auto field = top.field;
+				if (!field) break;
+				value_t value;
+				if (field->type == field_t::type_e::number && isNumber) {
+					value.numbers[0] = number;
+					value.count = 1;
+				} else if (field->type == field_t::type_e::string && text) {
+					value.text = *text;
+				} else {
+					throwMistyped(getValuePath(), field->getTypeName());
+				}
+				field->set(*this, top.record, value);
+				markSeen(top, field);
+				break;
+			}
+			case frame_t::type_e::objectArray:
+				throwMistyped(getValuePath(), top.kind->typeName);
+			case frame_t::type_e::pointArray:
+				throwMistyped(getValuePath(), VECTOR_TYPE);
+			case frame_t::type_e::valueArray:
+				if (!isNumber) throwMistyped(getValuePath(), top.field->getValueTypeName());
+				if (top.value.count < 3) top.value.numbers[top.value.count] = number;
+				top.value.count++;
+				break;
+			}
+			return true;
+		}
+
+		/// SAX interface
+
+		bool null() { return scalar(false, 0, nullptr); }
+		bool boolean(bool) { return scalar(false, 0, nullptr); }
+		bool number_integer(nlohmann::json::number_integer_t value) { return scalar(true, (extent_t)value, nullptr); }
+		bool number_unsigned(nlohmann::json::number_unsigned_t value) { return scalar(true, (extent_t)value, nullptr); }
+		bool number_float(nlohmann::json::number_float_t value, const nlohmann::json::string_t&) { return scalar(true, (extent_t)value, nullptr); }
+		bool string(nlohmann::json::string_t& value) { return scalar(false, 0, &value); }
+		template <typename T>
+		bool binary(T&) { return scalar(false, 0, nullptr); }
+
+		bool start_object(size_t) {
+			if (frames.empty()) {
+				auto& root = frames.emplace_back();
+				root.type = frame_t::type_e::object;
+				root.kind = &rootKind;
+				root.record = &space;
+				return true;
+			}
+
+			auto& top = frames.back();
+			if (top.type == frame_t::type_e::skip) {
+				top.skipDepth++;
+			} else if (top.type == frame_t::type_e::object) {
+				auto field = top.field;
+				if (!field) {
+					pushSkip();
+				} else if (field->type == field_t::type_e::object) {
+					auto kind = field->items;
+					auto record = kind->begin(*this, top.record);
+					auto& object = frames.emplace_back();
+					object.type = frame_t::type_e::object;
+					object.kind = kind;
+					object.record = record;
+				} else {
+					throwMistyped(getValuePath(), field->getTypeName());
+				}
+			} else if (top.type == frame_t::type_e::objectArray) {
+				auto kind = top.kind;
+				auto record = kind->begin(*this, top.record);
+				auto& object = frames.emplace_back();
+				object.type = frame_t::type_e::object;
+				object.kind = kind;
+				object.record = record;
+			} else {
+				throwMistyped(getValuePath(), top.field->getValueTypeName());
+			}
+			return true;
+		}
+
+		bool key(nlohmann::json::string_t& value) {
+			auto& top = frames.back();
+			if (top.type == frame_t::type_e::object) {
+				top.key = value;
+				top.field = findField(*top.kind, value);
+			}
+			return true;
+		}
+
+		bool end_object() {
+			auto& top = frames.back();
+			if (top.type == frame_t::type_e::skip) {
+				popSkip();
+				return true;
+			}
+
+			for (size_t i = 0, len = top.kind->fields.size(); i < len; i++) {
+				auto& field = top.kind->fields[i];
+				if (field.required && (top.seen & ((uint64_t)1 << i)) == 0) {
+					auto path = getPath(frames.size() - 1);
+					throw except::configValueMissing_ex(path.empty() ? field.name : path + "." + field.name);
+				}
+			}
+
+			// The path of the object must be available to the end callback, so it is popped after
+			if (top.kind->end) top.kind->end(*this, top.record);
+			frames.pop_back();
+			if (!frames.empty()) {
+				auto& parent = frames.back();
+				if (parent.type == frame_t::type_e::object) markSeen(parent, parent.field);
+				else parent.index++;
+			}
+			return true;
+		}
+
+		bool start_array(size_t) {
+			if (frames.empty()) throwMistyped("(root)", OBJECT_TYPE);
+			auto& top = frames.back();
+			if (top.type == frame_t::type_e::skip) {
+				top.skipDepth++;
+			} else if (top.type == frame_t::type_e::object) {
+				auto field = top.field;
+				if (!field) {
+					pushSkip();
+				} else if (field->type == field_t::type_e::objectArray) {
+					auto record = top.record;
+					auto& array = frames.emplace_back();
+					array.type = frame_t::type_e::objectArray;
+					array.kind = field->items;
+					array.field = field;
+					array.record = record;
+				} else if (field->type == field_t::type_e::vec2 || field->type == field_t::type_e::color) {
+					auto& array = frames.emplace_back();
+					array.type = frame_t::type_e::valueArray;
+					array.field = field;
+				} else if (field->type == field_t::type_e::vec2Array) {
+					auto& array = frames.emplace_back();
+					array.type = frame_t::type_e::pointArray;
+					array.field = field;
+				} else {
+					throwMistyped(getValuePath(), field->getTypeName());
+				}
+			} else if (top.type == frame_t::type_e::objectArray) {
+				throwMistyped(getValuePath(), top.kind->typeName);
+			} else if (top.type == frame_t::type_e::pointArray) {
+				auto field = top.field;
+				auto& array = frames.emplace_back();
+				array.type = frame_t::type_e::valueArray;
+				array.field = field;
+			} else {
+				throwMistyped(getValuePath(), top.field->getValueTypeName());
+			}
+			return true;
+		}
+
+		bool end_array() {
+			auto& top = frames.back();
+			if (top.type == frame_t::type_e::skip) {
+				popSkip();
+				return true;
+			}
+
+			auto field = top.field;
+			if (top.type == frame_t::type_e::valueArray) {
+				size_t expected = field->type == field_t::type_e::color ? 3 : 2;
+				if (top.value.count != expected) throwMistyped(getValuePath(), field->getValueTypeName());
+				auto value = top.value;
+				frames.pop_back();
+				auto& parent = frames.back();
+				if (parent.type == frame_t::type_e::pointArray) {
+					parent.value.points.push_back(value.toVec2());
+					parent.index++;
+				} else {
+					field->set(*this, parent.record, value);
+					markSeen(parent, field);
+				}
+			} else if (top.type == frame_t::type_e::pointArray) {
+				auto value = std::move(top.value);
+				frames.pop_back();
+				auto& object = frames.back();
+				field->set(*this, object.record, value);
+				markSeen(object, field);
+			} else {
+				frames.pop_back();
+				markSeen(frames.back(), field);
+			}
+			return true;
+		}
+
+		bool parse_error(size_t, const std::string&, const nlohmann::detail::exception& err) {
+			throw except::config_ex(std::string("Invalid json, ") + err.what());
+		}
+
+		void pushSkip() {
+			auto& skip = frames.emplace_back();
+			skip.type = frame_t::type_e::skip;
+			skip.skipDepth = 1;
+		}
+
+		void popSkip() {
+			auto& top = frames.back();
+			top.skipDepth--;
+			if (top.skipDepth == 0) frames.pop_back();
+		}
+	};
+
+	using type_e = field_t::type_e;
+
+	const kind_t LINE_KIND = {
+		"Line",
+		{
+			{ "a", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->a = value.toVec2(); } },
+			{ "b", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->b = value.toVec2(); } },
+			{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->reflectivity = value.toColor(); } },
+			{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->roughness = value.numbers[0]; } }
+		},
+		[](loader_t&, void* parent) -> void* {
+			return &((space_t*)parent)->objectHolder_t<line_t>::items.emplace_back();
+		}
+	};
+
+	using spawnerRecord_t = loader_t::spawnerRecord_t;
+
+	const kind_t SPAWNER_KIND = {
+		"Spawner",
+		{
+			{ "position", type_e::vec2, false, [](loader_t&, void* record, const value_t& value) {
+				auto spawnerRecord = (spawnerRecord_t*)record;
+				spawnerRecord->spawner.pos = value.toVec2();
+				spawnerRecord->hasPosition = true;
+			} },
+			{ "type", type_e::string, true, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->type = value.text; } },
+			{ "size", type_e::vec2, false, [](loader_t&, void* record, const value_t& value) {
+				auto spawnerRecord = (spawnerRecord_t*)record;
+				spawnerRecord->spawner.size = value.toVec2();
+				spawnerRecord->hasSize = true;
+			} },
+			{ "radius", type_e::number, false, [](loader_t&, void* record, const value_t& value) {
+				auto spawnerRecord = (spawnerRecord_t*)record;
+				spawnerRecord->spawner.size.x = value.numbers[0];
+				spawnerRecord->hasRadius = true;
+			} },
+			{ "a", type_e::vec2, false, [](loader_t&, void* record, const value_t& value) {
+				auto spawnerRecord = (spawnerRecord_t*)record;
+				spawnerRecord->a = value.toVec2();
+				spawnerRecord->hasA = true;
+			} },
+			{ "b", type_e::vec2, false, [](loader_t&, void* record, const value_t& value) {
+				auto spawnerRecord = (spawnerRecord_t*)record;
+				spawnerRecord->b = value.toVec2();
+				spawnerRecord->hasB = true;
+			} },
+			{ "color", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->spawner.color = value.toColor(); } },
+			{ "ratio", type_e::number, true, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->spawner.ratio = value.numbers[0]; } },
+			{ "spread", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->spawner.spread = value.numbers[0]; } },
+			{ "direction", type_e::vec2, false, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->spawner.direction = value.toVec2().normalize(); } },
+			{ "group", type_e::string, false, [](loader_t&, void* record, const value_t& value) { ((spawnerRecord_t*)record)->spawner.group = value.text; } }
+		},
+		[](loader_t& loader, void*) -> void* {
+			loader.spawnerRecord = spawnerRecord_t();
+			return &loader.spawnerRecord;
+		},
+		[](loader_t& loader, void* record) {
+			constexpr char TYPE_ENUM[] = "'square' | 'circle' | 'line'";
+			auto& spawnerRecord = *(spawnerRecord_t*)record;
+			auto path = [&](const char* name) { return loader.getPath(loader.frames.size() - 1) + "." + name; };
+
+			if (spawnerRecord.type == "square") {
+				spawnerRecord.spawner.type = spawner_t::type_e::square;
+				if (!spawnerRecord.hasPosition) throw except::configValueMissing_ex(path("position"));
+				if (!spawnerRecord.hasSize) throw except::configValueMissing_ex(path("size"));
+			} else if (spawnerRecord.type == "circle") {
+				spawnerRecord.spawner.type = spawner_t::type_e::circle;
+				if (!spawnerRecord.hasPosition) throw except::configValueMissing_ex(path("position"));
+				if (!spawnerRecord.hasRadius) throw except::configValueMissing_ex(path("radius"));
+			} else if (spawnerRecord.type == "line") {
+				// Line spawners are stored as the start and the offset to the end
+				spawnerRecord.spawner.type = spawner_t::type_e::line;
+				if (!spawnerRecord.hasA) throw except::configValueMissing_ex(path("a"));
+				if (!spawnerRecord.hasB) throw except::configValueMissing_ex(path("b"));
+				spawnerRecord.spawner.pos = spawnerRecord.a;
+				spawnerRecord.spawner.size = spawnerRecord.b - spawnerRecord.a;
+			} else {
+				throw except::configValueMistyped_ex(path("type"), TYPE_ENUM);
+			}
+
+			loader.space.spawners.push_back(spawnerRecord.spawner);
+		}
+	};
+
+	const kind_t SEGMENT_KIND = {
+		"Segment",
+		{
+			{ "a", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->a = value.toVec2(); } },
+			{ "b", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((line_t*)record)->b = value.toVec2(); } }
+		},
+		[](loader_t&, void* parent) -> void* {
+			return &((shapeDefinition_t*)parent)->items.emplace_back();
+		}
+	};
+
+	const kind_t SHAPE_KIND = {
+		"Shape",
+		{
+			{ "name", type_e::string, true, [](loader_t&, void* record, const value_t& value) { ((shapeDefinition_t*)record)->name = value.text; } },
+			{ "lines", type_e::objectArray, true, nullptr, &SEGMENT_KIND }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return loader.space.definitions.emplace_back(std::make_shared<shapeDefinition_t>()).get();
+		},
+		[](loader_t& loader, void*) {
+			auto& definition = loader.space.definitions.back();
+			definition->update();
+			if (!loader.definitionsByName.emplace(definition->name, definition).second) {
+				throw except::configValueInvalid_ex(loader.getPath(loader.frames.size() - 1) + ".name", "shape " + definition->name + " is already defined");
+			}
+		}
+	};
+
+	const kind_t INSTANCE_KIND = {
+		"Instance",
+		{
+			{ "shape", type_e::string, true, [](loader_t& loader, void*, const value_t& value) { loader.instanceShapes.back() = value.text; } },
+			{ "position", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((instance_t*)record)->transform.translation = value.toVec2(); } },
+			{ "rotation", type_e::number, false, [](loader_t&, void* record, const value_t& value) {
+				((instance_t*)record)->transform.rotation = value.numbers[0] * DEGREES_TO_RADIANS;
+			} },
+			{ "scale", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((instance_t*)record)->transform.scale = value.numbers[0]; } },
+			{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((instance_t*)record)->reflectivity = value.toColor(); } },
+			{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((instance_t*)record)->roughness = value.numbers[0]; } }
+		},
+		[](loader_t& loader, void*) -> void* {
+			loader.instanceShapes.emplace_back();
+			return &loader.space.objectHolder_t<instance_t>::items.emplace_back();
+		},
+		[](loader_t& loader, void* record) {
+			auto& instance = *(instance_t*)record;
+			if (!(instance.transform.scale > 0)) {
+				throw except::configValueInvalid_ex(loader.getPath(loader.frames.size() - 1) + ".scale", "must be greater than zero");
+			}
+			instance.transform.update();
+		}
+	};
+
+	const kind_t CIRCLE_KIND = {
+		"Circle",
+		{
+			{ "center", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((circle_t*)record)->center = value.toVec2(); } },
+			{ "radius", type_e::number, true, [](loader_t&, void* record, const value_t& value) { ((circle_t*)record)->radius = value.numbers[0]; } },
+			{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((circle_t*)record)->reflectivity = value.toColor(); } },
+			{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((circle_t*)record)->roughness = value.numbers[0]; } }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return &loader.space.objectHolder_t<circle_t>::items.emplace_back();
+		}
+	};
+
+	const kind_t ARC_KIND = {
+		"Arc",
+		{
+			{ "center", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->center = value.toVec2(); } },
+			{ "radius", type_e::number, true, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->radius = value.numbers[0]; } },
+			{ "start", type_e::number, true, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->start = value.numbers[0] * DEGREES_TO_RADIANS; } },
+			{ "end", type_e::number, true, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->end = value.numbers[0] * DEGREES_TO_RADIANS; } },
+			{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->reflectivity = value.toColor(); } },
+			{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((arc_t*)record)->roughness = value.numbers[0]; } }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return &loader.space.objectHolder_t<arc_t>::items.emplace_back();
+		},
+		[](loader_t&, void* record) {
+			((arc_t*)record)->update();
+		}
+	};
+
+	const kind_t BEZIER_KIND = {
+		"Bezier",
+		{
+			{ "a", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((bezier_t*)record)->a = value.toVec2(); } },
+			{ "control", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((bezier_t*)record)->control = value.toVec2(); } },
+			{ "b", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((bezier_t*)record)->b = value.toVec2(); } },
+			{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((bezier_t*)record)->reflectivity = value.toColor(); } },
+			{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((bezier_t*)record)->roughness = value.numbers[0]; } }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return &loader.space.objectHolder_t<bezier_t>::items.emplace_back();
+		}
+	};
+
+	/* Polygons and polylines only differ in being closed, which is set by begin */
+	const std::vector<field_t> POLYGON_FIELDS = {
+		{ "vertices", type_e::vec2Array, true, [](loader_t&, void* record, const value_t& value) { ((polygon_t*)record)->vertices = value.points; } },
+		{ "reflectivity", type_e::color, true, [](loader_t&, void* record, const value_t& value) { ((polygon_t*)record)->reflectivity = value.toColor(); } },
+		{ "roughness", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((polygon_t*)record)->roughness = value.numbers[0]; } }
+	};
+
+	void endPolygon(loader_t& loader, void* record) {
+		auto& polygon = *(polygon_t*)record;
+		size_t minimum = polygon.closed ? 3 : 2;
+		if (polygon.vertices.size() < minimum) {
+			throw except::configValueInvalid_ex(loader.getPath(loader.frames.size() - 1) + ".vertices", "expected at least " + std::to_string(minimum) + " vertices");
+		}
+		polygon.update();
+	}
+
+	const kind_t POLYGON_KIND = {
+		"Polygon",
+		POLYGON_FIELDS,
+		[](loader_t& loader, void*) -> void* {
+			auto& polygon = loader.space.objectHolder_t<polygon_t>::items.emplace_back();
+			polygon.closed = true;
+			return &polygon;
+		},
+		endPolygon
+	};
+
+	const kind_t POLYLINE_KIND = {
+		"Polyline",
+		POLYGON_FIELDS,
+		[](loader_t& loader, void*) -> void* {
+			auto& polygon = loader.space.objectHolder_t<polygon_t>::items.emplace_back();
+			polygon.closed = false;
+			return &polygon;
+		},
+		endPolygon
+	};
+
+	/* Sets the target of the track being read */
+	template <track_t::target_e target, bool polyline = false>
+	void setTrackTarget(loader_t& loader, void* record, const value_t& value) {
+		auto& track = *(track_t*)record;
+		auto& trackRecord = loader.trackRecords.back();
+		if (!(value.numbers[0] >= 0) || value.numbers[0] != std::floor(value.numbers[0])) {
+			throw except::configValueInvalid_ex(loader.getValuePath(), "must be an index");
+		}
+		track.target = target;
+		track.index = (size_t)value.numbers[0];
+		trackRecord.polyline = polyline;
+		trackRecord.targets++;
+	}
+
+	const kind_t KEYFRAME_KIND = {
+		"Keyframe",
+		{
+			{ "frame", type_e::number, true, [](loader_t& loader, void* record, const value_t& value) {
+				if (!(value.numbers[0] >= 0) || value.numbers[0] != std::floor(value.numbers[0])) {
+					throw except::configValueInvalid_ex(loader.getValuePath(), "must be a frame number");
+				}
+				((keyframe_t*)record)->frame = (size_t)value.numbers[0];
+			} },
+			{ "position", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((keyframe_t*)record)->position = value.toVec2(); } },
+			{ "rotation", type_e::number, false, [](loader_t&, void* record, const value_t& value) {
+				((keyframe_t*)record)->rotation = value.numbers[0] * DEGREES_TO_RADIANS;
+			} },
+			{ "scale", type_e::number, false, [](loader_t&, void* record, const value_t& value) { ((keyframe_t*)record)->scale = value.numbers[0]; } }
+		},
+		[](loader_t&, void* parent) -> void* {
+			return &((track_t*)parent)->keys.emplace_back();
+		},
+		[](loader_t& loader, void* record) {
+			if (!(((keyframe_t*)record)->scale > 0)) {
+				throw except::configValueInvalid_ex(loader.getPath(loader.frames.size() - 1) + ".scale", "must be greater than zero");
+			}
+		}
+	};
+
+	const kind_t TRACK_KIND = {
+		"Track",
+		{
+			{ "spawner", type_e::number, false, setTrackTarget<track_t::target_e::spawner> },
+			{ "instance", type_e::number, false, setTrackTarget<track_t::target_e::instance> },
+			{ "polygon", type_e::number, false, setTrackTarget<track_t::target_e::polygon> },
+			{ "polyline", type_e::number, false, setTrackTarget<track_t::target_e::polygon, true> },
+			{ "keys", type_e::objectArray, true, nullptr, &KEYFRAME_KIND }
+		},
+		[](loader_t& loader, void* parent) -> void* {
+			loader.trackRecords.emplace_back();
+			return &((animation_t*)parent)->tracks.emplace_back();
+		},
+		[](loader_t& loader, void* record) {
+			auto& track = *(track_t*)record;
+			auto path = loader.getPath(loader.frames.size() - 1);
+			if (loader.trackRecords.back().targets != 1) {
+				throw except::configValueInvalid_ex(path, "expected exactly one of spawner, instance, polygon or polyline");
+			}
+			if (track.keys.empty()) {
+				throw except::configValueInvalid_ex(path + ".keys", "expected at least one keyframe");
+			}
+			std::stable_sort(track.keys.begin(), track.keys.end(), [](const keyframe_t& a, const keyframe_t& b) {
+				return a.frame < b.frame;
+			});
+		}
+	};
+
+	const kind_t ANIMATION_KIND = {
+		"Animation",
+		{
+			{ "frames", type_e::number, true, [](loader_t& loader, void* record, const value_t& value) {
+				if (!(value.numbers[0] >= 1) || value.numbers[0] != std::floor(value.numbers[0])) {
+					throw except::configValueInvalid_ex(loader.getValuePath(), "must be a whole number greater than zero");
+				}
+				((animation_t*)record)->frames = (size_t)value.numbers[0];
+			} },
+			{ "tracks", type_e::objectArray, true, nullptr, &TRACK_KIND }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return &loader.space.animation;
+		}
+	};
+
+	const kind_t DETECTOR_KIND = {
+		"Detector",
+		{
+			{ "a", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((detector_t*)record)->a = value.toVec2(); } },
+			{ "b", type_e::vec2, true, [](loader_t&, void* record, const value_t& value) { ((detector_t*)record)->b = value.toVec2(); } },
+			{ "name", type_e::string, false, [](loader_t&, void* record, const value_t& value) { ((detector_t*)record)->name = value.text; } },
+			{ "bins", type_e::number, false, [](loader_t& loader, void* record, const value_t& value) {
+				if (!(value.numbers[0] >= 0) || value.numbers[0] != std::floor(value.numbers[0])) {
+					throw except::configValueInvalid_ex(loader.getValuePath(), "must be a whole number");
+				}
+				((detector_t*)record)->bins = (size_t)value.numbers[0];
+			} }
+		},
+		[](loader_t& loader, void*) -> void* {
+			return &loader.space.detectors.emplace_back();
+		},
+		[](loader_t& loader, void* record) {
+			auto& detector = *(detector_t*)record;
+			if (detector.a == detector.b) {
+				throw except::configValueInvalid_ex(loader.getPath(loader.frames.size() - 1) + ".b", "must differ from a");
+			}
+		}
+	};
+
+	/* Checks that the objects of the tracks exist and turns polygon and polyline indices into indices of the polygon holder */
+	void resolveTracks(loader_t& loader) {
+		auto& space = loader.space;
+		auto& polygons = space.objectHolder_t<polygon_t>::items;
+		std::vector<size_t> closed, open;
+		for (size_t i = 0, len = polygons.size(); i < len; i++) {
+			(polygons[i].closed ? closed : open).push_back(i);
+		}
+
+		auto& tracks = space.animation.tracks;
+		for (size_t i = 0, len = tracks.size(); i < len; i++) {
+			auto& track = tracks[i];
+			auto path = "animation.tracks[" + std::to_string(i) + "].";
+			bool polyline = loader.trackRecords[i].polyline;
+			if (track.target == track_t::target_e::spawner) {
+				if (track.index >= space.spawners.size()) throw except::configValueInvalid_ex(path + "spawner", "no spawner with this index");
+			} else if (track.target == track_t::target_e::instance) {
+				if (track.index >= space.objectHolder_t<instance_t>::items.size()) throw except::configValueInvalid_ex(path + "instance", "no instance with this index");
+			} else {
+				auto& indices = polyline ? open : closed;
+				const char* name = polyline ? "polyline" : "polygon";
+				if (track.index >= indices.size()) throw except::configValueInvalid_ex(path + name, std::string("no ") + name + " with this index");
+				track.index = indices[track.index];
+			}
+		}
+	}
+
+	const kind_t ROOT_KIND = {
+		"Space",
+		{
+			{ "size", type_e::vec2, true, [](loader_t& loader, void*, const value_t& value) { loader.space.size = value.toVec2(); } },
+			{ "lines", type_e::objectArray, true, nullptr, &LINE_KIND },
+			{ "spawners", type_e::objectArray, true, nullptr, &SPAWNER_KIND },
+			{ "shapes", type_e::objectArray, false, nullptr, &SHAPE_KIND },
+			{ "instances", type_e::objectArray, false, nullptr, &INSTANCE_KIND },
+			{ "circles", type_e::objectArray, false, nullptr, &CIRCLE_KIND },
+			{ "arcs", type_e::objectArray, false, nullptr, &ARC_KIND },
+			{ "beziers", type_e::objectArray, false, nullptr, &BEZIER_KIND },
+			{ "polygons", type_e::objectArray, false, nullptr, &POLYGON_KIND },
+			{ "polylines", type_e::objectArray, false, nullptr, &POLYLINE_KIND },
+			{ "animation", type_e::object, false, nullptr, &ANIMATION_KIND },
+			{ "detectors", type_e::objectArray, false, nullptr, &DETECTOR_KIND }
+		},
+		nullptr,
+		[](loader_t& loader, void*) {
+			resolveTracks(loader);
+
+			auto& instances = loader.space.objectHolder_t<instance_t>::items;
+			for (size_t i = 0, len = instances.size(); i < len; i++) {
+				auto& name = loader.instanceShapes[i];
+				auto definition = loader.definitionsByName.find(name);
+				if (definition == loader.definitionsByName.end()) {
+					throw except::configValueInvalid_ex("instances[" + std::to_string(i) + "].shape", "no shape named " + name);
+				}
+				instances[i].definition = definition->second;
+			}
+		}
+	};
+}
+
+void space_t::loadFromJson(const std::filesystem::path& path) {
+	std::ifstream file;
+	file.open(path, std::ios::binary);
+
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	clear();
+	spawners.clear();
+
+	loader_t loader(*this, ROOT_KIND);
+	nlohmann::json::sax_parse(file, &loader);
+
+	normalizeSpawners();
+}
+
+void space_t::saveToJson(const std::filesystem::path& path) const {
+	std::ofstream file;
+	file.open(path);
+
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	file.precision(std::numeric_limits<extent_t>::max_digits10);
+	auto vec2 = [&](const vec2_t& value) -> std::ostream& {
+		return file << "[ " << value.x << ", " << value.y << " ]";
+	};
+	auto color = [&](const color_t& value) -> std::ostream& {
+		return file << "[ " << value.r << ", " << value.g << ", " << value.b << " ]";
+	};
+
+	file << "{\n\t\"size\": ";
+	vec2(size) << ",\n\t\"lines\": [";
+	auto& lines = objectHolder_t<line_t>::items;
+	for (size_t i = 0, len = lines.size(); i < len; i++) {
+		auto& line = lines[i];
+		file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"a\": ";
+		vec2(line.a) << ", \"b\": ";
+		vec2(line.b) << ", \"reflectivity\": ";
+		color(line.reflectivity);
+		if (line.roughness != 0) file << ", \"roughness\": " << line.roughness;
+		file << " }";
+	}
+	file << "\n\t],\n\t\"spawners\": [";
+	for (size_t i = 0, len = spawners.size(); i < len; i++) {
+		auto& spawner = spawners[i];
+		file << (i == 0 ? "\n" : ",\n") << "\t\t{ ";
+		if (spawner.type == spawner_t::type_e::line) {
+			file << "\"type\": \"line\", \"a\": ";
+			vec2(spawner.pos) << ", \"b\": ";
+			vec2(spawner.pos + spawner.size);
+		} else {
+			file << "\"position\": ";
+			vec2(spawner.pos);
+			if (spawner.type == spawner_t::type_e::square) {
+				file << ", \"type\": \"square\", \"size\": ";
+				vec2(spawner.size);
+			} else {
+				file << ", \"type\": \"circle\", \"radius\": " << spawner.size.x;
+			}
+		}
+		file << ", \"color\": ";
+		color(spawner.color) << ", \"ratio\": " << spawner.ratio << ", \"spread\": " << spawner.spread;
+		if (!spawner.direction.isZero()) {
+			file << ", \"direction\": ";
+			vec2(spawner.direction);
+		}
+		if (!spawner.group.empty()) file << ", \"group\": " << nlohmann::json(spawner.group).dump();
+		file << " }";
+	}
+	file << "\n\t]";
+
+	if (!definitions.empty()) {
+		file << ",\n\t\"shapes\": [";
+		for (size_t i = 0, len = definitions.size(); i < len; i++) {
+			auto& definition = *definitions[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{\n\t\t\t\"name\": " << nlohmann::json(definition.name).dump() << ",\n\t\t\t\"lines\": [";
+			for (size_t j = 0, count = definition.items.size(); j < count; j++) {
+				file << (j == 0 ? "\n" : ",\n") << "\t\t\t\t{ \"a\": ";
+				vec2(definition.items[j].a) << ", \"b\": ";
+				vec2(definition.items[j].b) << " }";
+			}
+			file << "\n\t\t\t]\n\t\t}";
+		}
+		file << "\n\t]";
+	}
+
+	auto& instances = objectHolder_t<instance_t>::items;
+	if (!instances.empty()) {
+		file << ",\n\t\"instances\": [";
+		for (size_t i = 0, len = instances.size(); i < len; i++) {
+			auto& instance = instances[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"shape\": " << nlohmann::json(instance.definition->name).dump() << ", \"position\": ";
+			vec2(instance.transform.translation);
+			if (instance.transform.rotation != 0) file << ", \"rotation\": " << instance.transform.rotation / DEGREES_TO_RADIANS;
+			if (instance.transform.scale != 1) file << ", \"scale\": " << instance.transform.scale;
+			file << ", \"reflectivity\": ";
+			color(instance.reflectivity);
+			if (instance.roughness != 0) file << ", \"roughness\": " << instance.roughness;
+			file << " }";
+		}
+		file << "\n\t]";
+	}
+
+	auto material = [&](const shape_t& shape) {
+		file << ", \"reflectivity\": ";
+		color(shape.reflectivity);
+		if (shape.roughness != 0) file << ", \"roughness\": " << shape.roughness;
+		file << " }";
+	};
+
+	auto& circles = objectHolder_t<circle_t>::items;
+	if (!circles.empty()) {
+		file << ",\n\t\"circles\": [";
+		for (size_t i = 0, len = circles.size(); i < len; i++) {
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"center\": ";
+			vec2(circles[i].center) << ", \"radius\": " << circles[i].radius;
+			material(circles[i]);
+		}
+		file << "\n\t]";
+	}
+
+	auto& arcs = objectHolder_t<arc_t>::items;
+	if (!arcs.empty()) {
+		file << ",\n\t\"arcs\": [";
+		for (size_t i = 0, len = arcs.size(); i < len; i++) {
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"center\": ";
+			vec2(arcs[i].center) << ", \"radius\": " << arcs[i].radius
+				<< ", \"start\": " << arcs[i].start / DEGREES_TO_RADIANS << ", \"end\": " << arcs[i].end / DEGREES_TO_RADIANS;
+			material(arcs[i]);
+		}
+		file << "\n\t]";
+	}
+
+	auto& beziers = objectHolder_t<bezier_t>::items;
+	if (!beziers.empty()) {
+		file << ",\n\t\"beziers\": [";
+		for (size_t i = 0, len = beziers.size(); i < len; i++) {
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"a\": ";
+			vec2(beziers[i].a) << ", \"control\": ";
+			vec2(beziers[i].control) << ", \"b\": ";
+			vec2(beziers[i].b);
+			material(beziers[i]);
+		}
+		file << "\n\t]";
+	}
+
+	auto& polygons = objectHolder_t<polygon_t>::items;
+	for (bool closed : { true, false }) {
+		bool first = true;
+		for (auto& polygon : polygons) {
+			if (polygon.closed != closed) continue;
+			file << (first ? (closed ? ",\n\t\"polygons\": [\n" : ",\n\t\"polylines\": [\n") : ",\n") << "\t\t{ \"vertices\": [ ";
+			first = false;
+			for (size_t i = 0, len = polygon.vertices.size(); i < len; i++) {
+				if (i != 0) file << ", ";
+				vec2(polygon.vertices[i]);
+			}
+			file << " ]";
+			material(polygon);
+		}
+		if (!first) file << "\n\t]";
+	}
+
+	if (!detectors.empty()) {
+		file << ",\n\t\"detectors\": [";
+		for (size_t i = 0, len = detectors.size(); i < len; i++) {
+			auto& detector = detectors[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"a\": ";
+			vec2(detector.a) << ", \"b\": ";
+			vec2(detector.b);
+			if (!detector.name.empty()) file << ", \"name\": " << nlohmann::json(detector.name).dump();
+			if (detector.bins != 0) file << ", \"bins\": " << detector.bins;
+			file << " }";
+		}
+		file << "\n\t]";
+	}
+
+	if (!animation.isEmpty()) {
+		file << ",\n\t\"animation\": {\n\t\t\"frames\": " << animation.frames << ",\n\t\t\"tracks\": [";
+		for (size_t i = 0, len = animation.tracks.size(); i < len; i++) {
+			auto& track = animation.tracks[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t\t{ ";
+			if (track.target == track_t::target_e::spawner) {
+				file << "\"spawner\": " << track.index;
+			} else if (track.target == track_t::target_e::instance) {
+				file << "\"instance\": " << track.index;
+			} else {
+				// Polygons and polylines are written in separate arrays, so the index is counted among the ones of the same kind
+				bool closed = polygons[track.index].closed;
+				auto index = std::count_if(polygons.begin(), polygons.begin() + track.index, [closed](const polygon_t& polygon) {
+					return polygon.closed == closed;
+				});
+				file << (closed ? "\"polygon\": " : "\"polyline\": ") << index;
+			}
+			file << ", \"keys\": [";
+			for (size_t j = 0, count = track.keys.size(); j < count; j++) {
+				auto& key = track.keys[j];
+				file << (j == 0 ? "\n" : ",\n") << "\t\t\t\t{ \"frame\": " << key.frame << ", \"position\": ";
+				vec2(key.position);
+				if (key.rotation != 0) file << ", \"rotation\": " << key.rotation / DEGREES_TO_RADIANS;
+				if (key.scale != 1) file << ", \"scale\": " << key.scale;
+				file << " }";
+			}
+			file << "\n\t\t\t] }";
+		}
+		file << "\n\t\t]\n\t}";
+	}
+
+	file << "\n}\n";
+
+	if (file.fail()) throw std::runtime_error("Failed to write file " + std::filesystem::absolute(path).string());
+}
@@ -7,4 +7,12 @@ struct shape_t {
 	extent_t roughness = 0;
 	virtual vec2_t getNormal(const vec2_t& point) const = 0;
 	virtual extent_t getDist(const vec2_t& point) const = 0;
+	/* Index of the closest part of shapes made of multiple parts, so reflections between two parts of one shape are not ignored */
+	virtual size_t getPart(const vec2_t&) const { return 0; }
+	/* The normal and the part at the point, shapes made of parts override it to find the closest part once for both */
+	virtual std::pair<vec2_t, size_t> getSurface(const vec2_t& point) const { return { getNormal(point), getPart(point) }; }
+	/* Curved shapes can be hit twice in a row by the same photon, straight ones cannot */
+	virtual bool isCurved() const { return false; }
+	/* Only solid shapes contain points, photons inside them are killed */
+	virtual bool contains(const vec2_t&) const { return false; }
 };
\ No newline at end of file
@@ -2,9 +2,9 @@
 #include "space.h"
 #include "exceptions.h"
 
-void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& mousePos, std::function<void(const SDL_Rect&, double)> preDrawCallback) const {
-	extent_t w = surface->w;
-	extent_t h = surface->h;
+spaceView_t space_t::getView(int surfaceWidth, int surfaceHeight) const {
+	extent_t w = surfaceWidth;
+	extent_t h = surfaceHeight;
 
 	extent_t zoom = 1;
 	if ((size.x * zoom) < w) {
@@ -29,24 +29,68 @@ void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& m
 		(int)std::floor(size.y * zoom)
 	};
 
-	targetSpace.x = surface->w / 2 - targetSpace.w / 2;
-	targetSpace.y = surface->h / 2 - targetSpace.h / 2;
+	targetSpace.x = surfaceWidth / 2 - targetSpace.w / 2;
+	targetSpace.y = surfaceHeight / 2 - targetSpace.h / 2;
+
+	return spaceView_t{ zoom, targetSpace };
+}
+
+void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& mousePos, std::function<void(const SDL_Rect&, double)> preDrawCallback) const {
+	auto view = getView(surface->w, surface->h);
+	auto zoom = view.zoom;
+	auto& targetSpace = view.target;
 	// Drawing border around draw area
 	shapes::square(surface, SDL_Rect{ targetSpace.x - 1, targetSpace.y - 1, targetSpace.w + 2, targetSpace.h + 2 }, SDL_Color{ 255, 255, 255, 255 }, false);
 
 	preDrawCallback(targetSpace, zoom);
 
-	auto localToScreen = [&](const vec2_t& point) -> SDL_Point {
-		return ((point * zoom) + vec2_t(targetSpace.x, targetSpace.y));
-	};
-
-	auto screenToLocal = [&](const SDL_Point& point) -> vec2_t {
-		return (vec2_t(point) - vec2_t(targetSpace.x, targetSpace.y)) * (1 / zoom);
-	};
+	auto localToScreen = [&](const vec2_t& point) { return view.localToScreen(point); };
+	auto screenToLocal = [&](const SDL_Point& point) { return view.screenToLocal(point); };
 	// Drawing lines
 	for (auto& line : objectHolder_t<line_t>::items) {
 		shapes::line(surface, localToScreen(line.a), localToScreen(line.b), SDL_Color{ 0,255,0,255 });
 	}
+	// Drawing instances
+	for (auto& instance : objectHolder_t<instance_t>::items) {
+		for (auto& line : instance.definition->items) {
+			shapes::line(surface, localToScreen(instance.transform.toWorld(line.a)), localToScreen(instance.transform.toWorld(line.b)), SDL_Color{ 0, 160, 255, 255 });
+		}
+	}
+	// Drawing curves, arcs and Bézier curves are drawn as line strips
+	constexpr SDL_Color CURVE_COLOR = { 0, 255, 0, 255 };
+	constexpr int CURVE_SEGMENTS = 32;
+	for (auto& circle : objectHolder_t<circle_t>::items) {
+		shapes::circle(surface, localToScreen(circle.center), (int)std::floor(circle.radius * zoom), CURVE_COLOR, false);
+	}
+	for (auto& arc : objectHolder_t<arc_t>::items) {
+		auto last = localToScreen(arc.startPoint);
+		for (int i = 1; i <= CURVE_SEGMENTS; i++) {
+			auto angle = arc.start + arc.span * i / CURVE_SEGMENTS;
+			auto next = localToScreen(arc.center + vec2_t(std::cos(angle), std::sin(angle)) * arc.radius);
+			shapes::line(surface, last, next, CURVE_COLOR);
+			last = next;
+		}
+	}
+	for (auto& bezier : objectHolder_t<bezier_t>::items) {
+		auto last = localToScreen(bezier.a);
+		for (int i = 1; i <= CURVE_SEGMENTS; i++) {
+			extent_t t = (extent_t)i / CURVE_SEGMENTS;
+			auto next = localToScreen(lerp(lerp(bezier.a, bezier.control, t), lerp(bezier.control, bezier.b, t), t));
+			shapes::line(surface, last, next, CURVE_COLOR);
+			last = next;
+		}
+	}
+	// Drawing polygons
+	for (auto& polygon : objectHolder_t<polygon_t>::items) {
+		for (size_t i = 0, len = polygon.getEdgeCount(); i < len; i++) {
+			auto [a, b] = polygon.getEdge(i);
+			shapes::line(surface, localToScreen(a), localToScreen(b), SDL_Color{ 0, 255, 0, 255 });
+		}
+	}
+	// Drawing detectors
+	for (auto& detector : detectors) {
+		shapes::line(surface, localToScreen(detector.a), localToScreen(detector.b), SDL_Color{ 255, 0, 255, 255 });
+	}
 	// Drawing line normals
 	for (auto& line : objectHolder_t<line_t>::items) {
 		auto middle = localToScreen((line.a + line.b) * 0.5);
@@ -55,13 +99,15 @@ void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& m
 		shapes::line(surface, SDL_Point{ middle.x + offset.x, middle.y + offset.y }, SDL_Point{ middle.x + offset.x * 5, middle.y + offset.y * 5 }, SDL_Color{ 255, 0, 0, 255 });
 	}
 	// Drawing min dist from mouse and normal of the closest shape
-	if (drawMouse && !objectHolder_t<line_t>::items.empty()) {
+	if (drawMouse) {
 		auto worldPos = screenToLocal(mousePos);
 		auto closest = getClosestShape(worldPos);
-		shapes::circle(surface, mousePos, (int)std::floor(closest.second * zoom), SDL_Color{ 0, 255, 255, 255 }, false);
-		SDL_Point normal = closest.first->getNormal(worldPos) * 5;
-		// Normal line drawing
-		shapes::line(surface, mousePos, SDL_Point{ mousePos.x + normal.x, mousePos.y + normal.y }, SDL_Color{ 0, 255, 255, 255 });
+		if (closest.first) {
+			shapes::circle(surface, mousePos, (int)std::floor(closest.second * zoom), SDL_Color{ 0, 255, 255, 255 }, false);
+			SDL_Point normal = closest.first->getNormal(worldPos) * 5;
+			// Normal line drawing
+			shapes::line(surface, mousePos, SDL_Point{ mousePos.x + normal.x, mousePos.y + normal.y }, SDL_Color{ 0, 255, 255, 255 });
+		}
 	}
 	// Drawing spawners
 	for (auto& spawner : spawners) {
@@ -73,6 +119,8 @@ void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& m
 		} else if (spawner.type == spawner_t::type_e::circle) {
 			int radius = (int)(spawner.size.x * zoom);
 			shapes::circle(surface, pos, radius, SPAWNER_COLOR, false);
+		} else if (spawner.type == spawner_t::type_e::line) {
+			shapes::line(surface, pos, localToScreen(spawner.pos + spawner.size), SPAWNER_COLOR);
 		}
 		if (!spawner.direction.isZero()) {
 			auto end = localToScreen(spawner.pos + (spawner.direction * (5 / zoom)));
@@ -83,227 +131,351 @@ void space_t::drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& m
 
 extent_t space_t::getGlobalMinDist(const vec2_t& point) const {
 	auto min = std::numeric_limits<extent_t>::infinity();
-	{
-		auto dist = objectHolder_t<line_t>::getMinDist(point);
+	auto check = [&](extent_t dist) {
 		if (dist < min) min = dist;
-	}
+	};
+
+	check(objectHolder_t<line_t>::getMinDist(point));
+	check(objectHolder_t<instance_t>::getMinDist(point));
+	check(objectHolder_t<circle_t>::getMinDist(point));
+	check(objectHolder_t<arc_t>::getMinDist(point));
+	check(objectHolder_t<bezier_t>::getMinDist(point));
+	check(objectHolder_t<polygon_t>::getMinDist(point));
 
 	return min;
 }
 
-std::pair<const shape_t*, extent_t> space_t::getClosestShape(const vec2_t& point) const {
+std::pair<const shape_t*, extent_t> space_t::getClosestShape(const vec2_t& point, size_t* evaluations) const {
 	auto min = std::numeric_limits<extent_t>::infinity();
 	const shape_t* target = nullptr;
-	{
-		auto dist = objectHolder_t<line_t>::getClosest(point);
+	auto check = [&](auto dist) {
 		if (dist.second < min) {
 			min = dist.second;
 			target = dist.first;
 		}
-	}
+	};
+
+	check(objectHolder_t<line_t>::getClosest(point, evaluations));
+	check(objectHolder_t<instance_t>::getClosest(point, evaluations));
+	check(objectHolder_t<circle_t>::getClosest(point, evaluations));
+	check(objectHolder_t<arc_t>::getClosest(point, evaluations));
+	check(objectHolder_t<bezier_t>::getClosest(point, evaluations));
+	check(objectHolder_t<polygon_t>::getClosest(point, evaluations));
 
 	return { target, min };
 }
 
-void space_t::loadFromFile(const std::filesystem::path& path) {
-	std::ifstream file;
-
-	constexpr char
-		VECTOR_TYPE[] = "[x : number, y : number]",
-		COLOR_TYPE[] = "[r : number, g : number, b : number]",
-		SIZE[] = "size",
-		COLOR[] = "color",
-		LINES[] = "lines",
-		LINE_TYPE[] = "Line",
-		POINT_A[] = "a",
-		POINT_B[] = "b",
-		SPAWNERS[] = "spawners",
-		SPAWNER_TYPE[] = "Spawner",
-		POSITION[] = "position",
-		SPREAD[] = "spread",
-		DIRECTION[] = "direction",
-		WAVELENGTH_MIN[] = "wavelengthMin",
-		WAVELENGTH_MAX[] = "wavelengthMax",
-		RATIO[] = "ratio",
-		RADIUS[] = "radius",
-		TYPE[] = "type",
-		TYPE_ENUM[] = "'square' | 'circle'",
-		NUMBER_TYPE[] = "number",
-		REFLECTIVITY[] = "reflectivity",
-		ROUGHNESS[] = "roughness"
-		;
-
-	std::string arrStart = "[";
-
-	file.open(path);
-
-	if (file.fail()) {
-		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+bool space_t::isInsideSolid(const vec2_t& point) const {
+	for (auto& polygon : objectHolder_t<polygon_t>::items) {
+		if (polygon.contains(point)) return true;
 	}
+	return false;
+}
 
-	auto json = nlohmann::json::parse(file);
+size_t space_t::getShapeCount() const {
+	return objectHolder_t<line_t>::items.size() +
+		objectHolder_t<instance_t>::items.size() +
+		objectHolder_t<circle_t>::items.size() +
+		objectHolder_t<arc_t>::items.size() +
+		objectHolder_t<bezier_t>::items.size() +
+		objectHolder_t<polygon_t>::items.size();
+}
+
+size_t space_t::getShapeIndex(const shape_t* shape) const {
+	// The shape is found by its address, it must point into one of the holders
+	auto address = (const char*)dynamic_cast<const void*>(shape);
+	size_t offset = 0;
+	std::optional<size_t> index;
+	auto check = [&](const auto& items) {
+		if (index) return;
+		auto begin = (const char*)items.data();
+		auto end = (const char*)(items.data() + items.size());
+		if (address >= begin && address < end) index = offset + (size_t)(address - begin) / sizeof(items[0]);
+		offset += items.size();
+	};
 
-	auto parseVec2 = [&](const nlohmann::json::value_type& value, const std::string& name) {
-		if (!value.is_array()
-			|| value.size() != 2
-			|| !value.at(0).is_number()
-			|| !value.at(1).is_number()
-			) throw except::configValueMistyped_ex(name, VECTOR_TYPE);
+	check(objectHolder_t<line_t>::items);
+	check(objectHolder_t<instance_t>::items);
+	check(objectHolder_t<circle_t>::items);
+	check(objectHolder_t<arc_t>::items);
+	check(objectHolder_t<bezier_t>::items);
+	check(objectHolder_t<polygon_t>::items);
 
-		return vec2_t(value.at(0), value.at(1));
+	if (!index) throw std::out_of_range("The shape is not in the space");
+	return *index;
+}
+
+bool space_t::hasRoughness() const {
+	auto check = [](const auto& items) {
+		return std::any_of(items.begin(), items.end(), [](const shape_t& shape) { return shape.roughness != 0; });
 	};
+	return check(objectHolder_t<line_t>::items) ||
+		check(objectHolder_t<instance_t>::items) ||
+		check(objectHolder_t<circle_t>::items) ||
+		check(objectHolder_t<arc_t>::items) ||
+		check(objectHolder_t<bezier_t>::items) ||
+		check(objectHolder_t<polygon_t>::items);
+}
 
-	auto parseColor = [&](const nlohmann::json::value_type& value, const std::string& name) {
-		if (!value.is_array()
-			|| value.size() != 3
-			|| !value.at(0).is_number()
-			|| !value.at(1).is_number()
-			|| !value.at(2).is_number()
-			) throw except::configValueMistyped_ex(name, COLOR_TYPE);
+bool space_t::hasCurves() const {
+	return !objectHolder_t<circle_t>::items.empty() || !objectHolder_t<arc_t>::items.empty() || !objectHolder_t<bezier_t>::items.empty();
+}
 
-		return color_t(value.at(0), value.at(1), value.at(2));
+const shape_t& space_t::getShape(size_t index) const {
+	const shape_t* shape = nullptr;
+	auto check = [&](const auto& items) {
+		if (shape) return;
+		if (index < items.size()) shape = &items[index];
+		else index -= items.size();
 	};
 
-	{
-		auto sizeValue = json.find("size");
-		if (sizeValue == json.end()) throw except::configValueMissing_ex(SIZE);
+	check(objectHolder_t<line_t>::items);
+	check(objectHolder_t<instance_t>::items);
+	check(objectHolder_t<circle_t>::items);
+	check(objectHolder_t<arc_t>::items);
+	check(objectHolder_t<bezier_t>::items);
+	check(objectHolder_t<polygon_t>::items);
 
-		size = parseVec2(*sizeValue, "size");
+	if (!shape) throw std::out_of_range("No shape " + std::to_string(index));
+	return *shape;
+}
+
+namespace {
+	bool isBinaryScene(const std::filesystem::path& path) {
+		return path.extension() == ".lsb";
+	}
+}
+
+void space_t::loadFromFile(const std::filesystem::path& path) {
+	if (isBinaryScene(path)) loadFromBinary(path);
+	else loadFromJson(path);
+}
+
+void space_t::saveToFile(const std::filesystem::path& path) const {
+	if (isBinaryScene(path)) saveToBinary(path);
+	else saveToJson(path);
+}
+
+std::optional<size_t> space_t::getSpawnerAt(const vec2_t& point, extent_t maxDist) const {
+	std::optional<size_t> found;
+	extent_t min = maxDist;
+	for (size_t i = 0, len = spawners.size(); i < len; i++) {
+		auto& spawner = spawners[i];
+		extent_t dist = (point - spawner.pos).length();
+		if (spawner.type == spawner_t::type_e::square) {
+			auto offset = point - spawner.pos;
+			if (std::abs(offset.x) <= spawner.size.x / 2 && std::abs(offset.y) <= spawner.size.y / 2) dist = 0;
+		} else if (spawner.type == spawner_t::type_e::circle) {
+			dist = std::max(dist - spawner.size.x, (extent_t)0);
+		} else if (spawner.type == spawner_t::type_e::line) {
+			dist = line_t(spawner.pos, spawner.pos + spawner.size).getDist(point);
+		}
+		if (dist <= min) {
+			min = dist;
+			found = i;
+		}
+	}
+	return found;
+}
+
+void space_t::normalizeSpawners() {
+	auto sum = std::accumulate(spawners.begin(), spawners.end(), 0.0, [](double value, const spawner_t& spawner) {
+		return value + spawner.ratio;
+	});
+
+	std::for_each(spawners.begin(), spawners.end(), [sum](spawner_t& spawner) {
+		spawner.ratio /= sum;
+	});
+
+	std::vector<double> weights(spawners.size());
+	std::transform(spawners.begin(), spawners.end(), weights.begin(), [](const spawner_t& spawner) {
+		return spawner.ratio;
+	});
+	spawnerTable.build(weights);
+
+	spawnerLayers.resize(spawners.size());
+	layerNames.clear();
+	std::unordered_map<std::string, uint32_t> groups;
+	for (size_t i = 0, len = spawners.size(); i < len; i++) {
+		auto& group = spawners[i].group;
+		if (group.empty()) {
+			spawnerLayers[i] = (uint32_t)layerNames.size();
+			layerNames.push_back("spawner " + std::to_string(i));
+		} else {
+			auto [iter, added] = groups.emplace(group, (uint32_t)layerNames.size());
+			if (added) layerNames.push_back(group);
+			spawnerLayers[i] = iter->second;
+		}
+	}
+}
+
+spaceChanges_t space_t::applyChanges(space_t&& updated) {
+	spaceChanges_t changes;
+
+	if (size != updated.size) {
+		size = updated.size;
+		changes.sizeChanged = true;
 	}
 
 	{
-		auto linesValue = json.find("lines");
-		if (linesValue == json.end()) throw except::configValueMissing_ex(LINES);
-		if (!linesValue->is_array()) throw except::configValueMistyped_ex(LINES, LINE_TYPE + std::string("[]"));
-
-		objectHolder_t<line_t>::items.clear();
-		objectHolder_t<line_t>::items.reserve(linesValue->size());
-		for (size_t i = 0, len = linesValue->size(); i < len; i++) {
-			auto& lineValue = linesValue->at(i);
-			auto& line = objectHolder_t<line_t>::items.emplace_back();
-			std::string linesPtr = LINES + arrStart + std::to_string(i) + "]";
-			if (!lineValue.is_object()) throw except::configValueMistyped_ex(linesPtr, LINE_TYPE);
-			{
-				auto point = lineValue.find(POINT_A);
-				std::string ptr = linesPtr + "." + POINT_A;
-				if (point == lineValue.end()) throw except::configValueMissing_ex(ptr);
-
-				line.a = parseVec2(*point, ptr);
+		auto& lines = objectHolder_t<line_t>::items;
+		auto& updatedLines = updated.objectHolder_t<line_t>::items;
+		auto common = std::min(lines.size(), updatedLines.size());
+		for (size_t i = 0; i < common; i++) {
+			auto& line = lines[i];
+			auto& updatedLine = updatedLines[i];
+			if (line.a != updatedLine.a || line.b != updatedLine.b) {
+				line = updatedLine;
+				changes.changedGeometry.push_back(i);
+			} else if (line.reflectivity != updatedLine.reflectivity || line.roughness != updatedLine.roughness) {
+				line.reflectivity = updatedLine.reflectivity;
+				line.roughness = updatedLine.roughness;
+				changes.changedMaterial.push_back(i);
 			}
-			{
-				auto point = lineValue.find(POINT_B);
-				std::string ptr = linesPtr + "." + POINT_B;
-				if (point == lineValue.end()) throw except::configValueMissing_ex(ptr);
+		}
 
-				line.b = parseVec2(*point, ptr);
+		if (updatedLines.size() < lines.size()) {
+			changes.removedLines = lines.size() - updatedLines.size();
+			lines.resize(updatedLines.size());
+		} else {
+			for (size_t i = common, len = updatedLines.size(); i < len; i++) {
+				lines.push_back(updatedLines[i]);
+				changes.changedGeometry.push_back(i);
 			}
-			{
-				auto color = lineValue.find(REFLECTIVITY);
-				std::string ptr = linesPtr + "." + REFLECTIVITY;
-				if (color == lineValue.end()) throw except::configValueMissing_ex(ptr);
+		}
+	}
 
-				line.reflectivity = parseColor(*color, ptr);
-			}
-			{
-				auto number = lineValue.find(ROUGHNESS);
-				std::string ptr = linesPtr + "." + ROUGHNESS;
-				if (number == lineValue.end()) line.roughness = 0;
-				else line.roughness = number->get<double>();
-			}
+	{
+		auto equal = [](const spawner_t& a, const spawner_t& b) {
+			return a.type == b.type && a.size == b.size && a.pos == b.pos && a.color == b.color
+				&& a.ratio == b.ratio && a.direction == b.direction && a.spread == b.spread && a.group == b.group;
+		};
+
+		if (!std::equal(spawners.begin(), spawners.end(), updated.spawners.begin(), updated.spawners.end(), equal)) {
+			spawners = std::move(updated.spawners);
+			spawnerTable = std::move(updated.spawnerTable);
+			spawnerLayers = std::move(updated.spawnerLayers);
+			layerNames = std::move(updated.layerNames);
+			changes.spawnersChanged = true;
 		}
 	}
 
 	{
-		auto spawnersValue = json.find(SPAWNERS);
-		if (spawnersValue == json.end()) throw except::configValueMissing_ex(SPAWNERS);
-		if (!spawnersValue->is_array()) throw except::configValueMistyped_ex(SPAWNERS, SPAWNER_TYPE + arrStart + "]");
-
-		spawners.clear();
-		spawners.reserve(spawnersValue->size());
-		for (size_t i = 0, len = spawnersValue->size(); i < len; i++) {
-			auto& spawnerValue = spawnersValue->at(i);
-			auto& spawner = spawners.emplace_back();
-			std::string spawnerPtr = SPAWNERS + arrStart + std::to_string(i) + "]";
-			if (!spawnerValue.is_object()) throw except::configValueMistyped_ex(spawnerPtr, SPAWNER_TYPE);
-
-			{
-				auto point = spawnerValue.find(POSITION);
-				std::string ptr = spawnerPtr + "." + POSITION;
-				if (point == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
-
-				spawner.pos = parseVec2(*point, ptr);
-			}
+		auto equalLines = [](const line_t& a, const line_t& b) {
+			return a.a == b.a && a.b == b.b;
+		};
+		auto equalDefinitions = [&](const std::shared_ptr<shapeDefinition_t>& a, const std::shared_ptr<shapeDefinition_t>& b) {
+			return a->name == b->name && std::equal(a->items.begin(), a->items.end(), b->items.begin(), b->items.end(), equalLines);
+		};
+		auto equalInstances = [](const instance_t& a, const instance_t& b) {
+			return a.definition->name == b.definition->name && a.transform.translation == b.transform.translation
+				&& a.transform.rotation == b.transform.rotation && a.transform.scale == b.transform.scale
+				&& a.reflectivity == b.reflectivity && a.roughness == b.roughness;
+		};
+
+		auto& instances = objectHolder_t<instance_t>::items;
+		auto& updatedInstances = updated.objectHolder_t<instance_t>::items;
+		if (
+			!std::equal(definitions.begin(), definitions.end(), updated.definitions.begin(), updated.definitions.end(), equalDefinitions) ||
+			!std::equal(instances.begin(), instances.end(), updatedInstances.begin(), updatedInstances.end(), equalInstances)
+			) {
+			definitions = std::move(updated.definitions);
+			instances = std::move(updatedInstances);
+			changes.instancesChanged = true;
+		}
+	}
 
-			{
-				auto typeValue = spawnerValue.find(TYPE);
-				std::string ptr = spawnerPtr + "." + TYPE;
-				if (typeValue == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
-				if (!typeValue->is_string()) throw except::configValueMistyped_ex(ptr, TYPE_ENUM);
-
-				auto type = typeValue->get<std::string>();
-				if (type == "square") {
-					spawner.type = spawner_t::type_e::square;
-					{
-						auto point = spawnerValue.find(SIZE);
-						std::string ptr = spawnerPtr + "." + SIZE;
-						if (point == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
-
-						spawner.size = parseVec2(*point, ptr);
-					}
-				} else if (type == "circle") {
-					spawner.type = spawner_t::type_e::circle;
-					{
-						auto numberValue = spawnerValue.find(RADIUS);
-						std::string ptr = spawnerPtr + "." + RADIUS;
-						if (numberValue == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
-						if (!numberValue->is_number()) throw except::configValueMistyped_ex(ptr, NUMBER_TYPE);
-
-						spawner.size.x = numberValue->get<extent_t>();
-					}
-				} else {
-					throw except::configValueMistyped_ex(ptr, TYPE_ENUM);
-				}
-			}
+	{
+		auto equalMaterial = [](const shape_t& a, const shape_t& b) {
+			return a.reflectivity == b.reflectivity && a.roughness == b.roughness;
+		};
+		auto equalCircles = [&](const circle_t& a, const circle_t& b) {
+			return a.center == b.center && a.radius == b.radius && equalMaterial(a, b);
+		};
+		auto equalArcs = [&](const arc_t& a, const arc_t& b) {
+			return a.center == b.center && a.radius == b.radius && a.start == b.start && a.end == b.end && equalMaterial(a, b);
+		};
+		auto equalBeziers = [&](const bezier_t& a, const bezier_t& b) {
+			return a.a == b.a && a.control == b.control && a.b == b.b && equalMaterial(a, b);
+		};
+
+		auto& circles = objectHolder_t<circle_t>::items;
+		auto& arcs = objectHolder_t<arc_t>::items;
+		auto& beziers = objectHolder_t<bezier_t>::items;
+		auto& updatedCircles = updated.objectHolder_t<circle_t>::items;
+		auto& updatedArcs = updated.objectHolder_t<arc_t>::items;
+		auto& updatedBeziers = updated.objectHolder_t<bezier_t>::items;
+		if (
+			!std::equal(circles.begin(), circles.end(), updatedCircles.begin(), updatedCircles.end(), equalCircles) ||
+			!std::equal(arcs.begin(), arcs.end(), updatedArcs.begin(), updatedArcs.end(), equalArcs) ||
+			!std::equal(beziers.begin(), beziers.end(), updatedBeziers.begin(), updatedBeziers.end(), equalBeziers)
+			) {
+			circles = std::move(updatedCircles);
+			arcs = std::move(updatedArcs);
+			beziers = std::move(updatedBeziers);
+			changes.curvesChanged = true;
+		}
+	}
 
-			{
-				auto point = spawnerValue.find(COLOR);
-				std::string ptr = spawnerPtr + "." + COLOR;
-				if (point == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
+	{
+		auto equalPolygons = [](const polygon_t& a, const polygon_t& b) {
+			return a.closed == b.closed && a.vertices == b.vertices && a.reflectivity == b.reflectivity && a.roughness == b.roughness;
+		};
+
+		auto& polygons = objectHolder_t<polygon_t>::items;
+		auto& updatedPolygons = updated.objectHolder_t<polygon_t>::items;
+		if (!std::equal(polygons.begin(), polygons.end(), updatedPolygons.begin(), updatedPolygons.end(), equalPolygons)) {
+			polygons = std::move(updatedPolygons);
+			changes.polygonsChanged = true;
+		}
+	}
 
-				spawner.color = parseColor(*point, ptr);
-			}
-			{
-				auto numberValue = spawnerValue.find(RATIO);
-				std::string ptr = spawnerPtr + "." + RATIO;
-				if (numberValue == spawnerValue.end()) throw except::configValueMissing_ex(ptr);
-				if (!numberValue->is_number()) throw except::configValueMistyped_ex(ptr, NUMBER_TYPE);
+	if (!(animation == updated.animation)) {
+		animation = std::move(updated.animation);
+		changes.animationChanged = true;
+	}
 
-				spawner.ratio = numberValue->get<extent_t>();
-			}
-			{
-				auto numberValue = spawnerValue.find(SPREAD);
-				std::string ptr = spawnerPtr + "." + SPREAD;
-				if (numberValue == spawnerValue.end()) spawner.spread = 1;
-				else {
-					if (!numberValue->is_number()) throw except::configValueMistyped_ex(ptr, NUMBER_TYPE);
-					spawner.spread = numberValue->get<extent_t>();
-				}
+	if (detectors != updated.detectors) {
+		detectors = std::move(updated.detectors);
+		changes.detectorsChanged = true;
+	}
+
+	return changes;
+}
+
+void space_t::applyFrame(const space_t& rest, size_t frame) {
+	for (auto& track : rest.animation.tracks) {
+		auto key = track.sample(frame);
+		transform_t transform;
+		transform.rotation = key.rotation;
+		transform.update();
+
+		if (track.target == track_t::target_e::spawner) {
+			auto& source = rest.spawners[track.index];
+			auto& spawner = spawners[track.index];
+			spawner.direction = transform.rotate(source.direction);
+			if (source.type == spawner_t::type_e::line) {
+				spawner.size = transform.rotate(source.size) * key.scale;
+				spawner.pos = key.position - spawner.size * 0.5;
+			} else {
+				spawner.size = source.size * key.scale;
+				spawner.pos = key.position;
 			}
-			{
-				auto point = spawnerValue.find(DIRECTION);
-				std::string ptr = spawnerPtr + "." + DIRECTION;
-				if (point == spawnerValue.end()) spawner.direction = {};
-				else spawner.direction = parseVec2(*point, ptr).normalize();
+		} else if (track.target == track_t::target_e::instance) {
+			auto& source = rest.objectHolder_t<instance_t>::items[track.index];
+			auto& instance = objectHolder_t<instance_t>::items[track.index];
+			instance.transform.translation = key.position;
+			instance.transform.rotation = source.transform.rotation + key.rotation;
+			instance.transform.scale = source.transform.scale * key.scale;
+			instance.transform.update();
+		} else {
+			auto& source = rest.objectHolder_t<polygon_t>::items[track.index];
+			auto& polygon = objectHolder_t<polygon_t>::items[track.index];
+			auto center = (source.min + source.max) * 0.5;
+			for (size_t i = 0, len = source.vertices.size(); i < len; i++) {
+				polygon.vertices[i] = transform.rotate(source.vertices[i] - center) * key.scale + key.position;
 			}
+			polygon.update();
 		}
 	}
-
-	// Normalize the spawner ratios
-	auto sum = std::accumulate(spawners.begin(), spawners.end(), 0.0, [](double value, const spawner_t& spawner) {
-		return value + spawner.ratio;
-	});
-
-	std::for_each(spawners.begin(), spawners.end(), [sum](spawner_t& spawner) {
-		spawner.ratio /= sum;
-	});
 }
\ No newline at end of file
@@ -1,71 +1,175 @@
 #pragma once
 #include "vectors.h"
 #include "line.h"
+#include "objectHolder.h"
+#include "instance.h"
+#include "circle.h"
+#include "arc.h"
+#include "bezier.h"
+#include "polygon.h"
+#include "aliasTable.h"
+#include "animation.h"
+#include "detector.h"
 #include "pch.h"
 
-template <typename T>
-struct objectHolder_t {
-	std::vector<T> items;
-
-	extent_t getMinDist(const vec2_t& point) const {
-		extent_t min = std::numeric_limits<extent_t>::infinity();
-		for (size_t i = 0, len = items.size(); i < len; i++) {
-			extent_t dist = items[i].getDist(point);
-			if (dist < min) {
-				min = dist;
-			}
-		}
-		return min;
-	}
-
-	std::pair<const T*, extent_t> getClosest(const vec2_t& point) const {
-		extent_t min = std::numeric_limits<extent_t>::infinity();
-		const T* target = nullptr;
-		for (size_t i = 0, len = items.size(); i < len; i++) {
-			extent_t dist = items[i].getDist(point);
-			if (dist < min) {
-				min = dist;
-				target = &items[i];
-			}
-		}
-		return { target, min };
-	}
-
-	objectHolder_t() : items() {}
-};
-
 struct spawner_t {
 	enum class type_e {
 		square,
-		circle
+		circle,
+		/* Emits from a line, like a lit panel */
+		line
 	};
 
 	type_e type = type_e::square;
-	// Other than being a size of a square spawner, the x component is also the radius of a circle spawner
+	// Other than being a size of a square spawner, the x component is also the radius of a circle spawner and for line spawners it is the offset from pos to the other end
 	vec2_t size;
 	vec2_t pos;
 	color_t color;
 	extent_t ratio = 1;
 	vec2_t direction;
 	extent_t spread = 1;
+	/* Spawners of the same light group are accumulated into one layer, empty if the spawner has a layer of its own */
+	std::string group;
+};
+
+/* Result of space_t::applyChanges */
+struct spaceChanges_t {
+	bool sizeChanged = false;
+	/* Indices of the lines whose geometry changed, including the added lines */
+	std::vector<size_t> changedGeometry;
+	/* Indices of the lines where only the reflectivity or roughness changed */
+	std::vector<size_t> changedMaterial;
+	/* The amount of lines removed from the end */
+	size_t removedLines = 0;
+	bool spawnersChanged = false;
+	/* Instances and definitions are replaced as a whole when any of them changes */
+	bool instancesChanged = false;
+	/* Circles, arcs and Bézier curves are replaced as a whole when any of them changes */
+	bool curvesChanged = false;
+	/* Polygons and polylines are replaced as a whole when any of them changes */
+	bool polygonsChanged = false;
+	/* The animation does not change the shown frame, only the frames rendered by a sequence */
+	bool animationChanged = false;
+	/* Detectors do not change the image, only what the renders measure */
+	bool detectorsChanged = false;
+
+	/* True if only the materials of lines changed, the paths of photons stay the same */
+	inline bool isMaterialOnly() const {
+		return !changedMaterial.empty() && !sizeChanged && changedGeometry.empty() && removedLines == 0 && !spawnersChanged && !instancesChanged && !curvesChanged && !polygonsChanged;
+	}
+
+	inline bool isEmpty() const {
+		return !sizeChanged && changedGeometry.empty() && changedMaterial.empty() && removedLines == 0 && !spawnersChanged && !instancesChanged && !curvesChanged && !polygonsChanged && !animationChanged && !detectorsChanged;
+	}
 };
 
-struct space_t : public objectHolder_t<line_t> {
+/* Where the space is drawn on a surface */
+struct spaceView_t {
+	/* Pixels per space unit */
+	extent_t zoom = 1;
+	/* The rectangle the space covers on the surface */
+	SDL_Rect target = {};
+
+	inline SDL_Point localToScreen(const vec2_t& point) const {
+		return ((point * zoom) + vec2_t(target.x, target.y));
+	}
+
+	inline vec2_t screenToLocal(const SDL_Point& point) const {
+		return (vec2_t(point) - vec2_t(target.x, target.y)) * (1 / zoom);
+	}
+};
+
+struct space_t :
+	public objectHolder_t<line_t>,
+	public objectHolder_t<instance_t>,
+	public objectHolder_t<circle_t>,
+	public objectHolder_t<arc_t>,
+	public objectHolder_t<bezier_t>,
+	public objectHolder_t<polygon_t> {
 	vec2_t size;
 
+	/* Shared by the instances that place them */
+	std::vector<std::shared_ptr<shapeDefinition_t>> definitions;
+
 	std::vector<spawner_t> spawners;
+	/* Picks the spawner of every photon by the spawner ratios, built by normalizeSpawners() */
+	aliasTable_t spawnerTable;
+	/* The layer of every spawner, built by normalizeSpawners() */
+	std::vector<uint32_t> spawnerLayers;
+	/* The name of every layer, the group name or "spawner <index>" for a spawner that has the layer to itself */
+	std::vector<std::string> layerNames;
+
+	/* Measure the photons crossing them, they are not shapes and photons pass through them */
+	std::vector<detector_t> detectors;
+
+	/* The objects of the room are the rest state, the animation only moves them in the frames made by applyFrame() */
+	animation_t animation;
 
+	/* Fits the space into the middle of a surface of the size, keeping the aspect ratio */
+	spaceView_t getView(int surfaceWidth, int surfaceHeight) const;
 	void drawDebug(SDL_Surface* surface, bool drawMouse, const SDL_Point& mousePos, std::function<void(const SDL_Rect&, double)> preDrawCallback) const;
 
 	extent_t getGlobalMinDist(const vec2_t& point) const;
-	std::pair<const shape_t*, extent_t> getClosestShape(const vec2_t& point) const;
+	/* If evaluations is not null, the amount of distance functions evaluated is added to it */
+	std::pair<const shape_t*, extent_t> getClosestShape(const vec2_t& point, size_t* evaluations = nullptr) const;
+	/* Returns true if the point is inside a solid shape */
+	bool isInsideSolid(const vec2_t& point) const;
+	/* The shapes are numbered in the order lines, instances, circles, arcs, Bézier curves and polygons */
+	size_t getShapeCount() const;
+	/* Returns the number of a shape of this space, like the one returned by getClosestShape() */
+	size_t getShapeIndex(const shape_t* shape) const;
+	const shape_t& getShape(size_t index) const;
+	/* True if a shape has a roughness, photons then scatter when they collide */
+	bool hasRoughness() const;
+	/* True if the space has circles, arcs or Bézier curves, which can be hit again right after a reflection */
+	bool hasCurves() const;
 
+	/* Loads .lsb files as binary scenes and everything else as json */
 	void loadFromFile(const std::filesystem::path& file);
+	/* Streams the json file straight into the space, defined in sceneJson.cpp */
+	void loadFromJson(const std::filesystem::path& file);
+	void saveToJson(const std::filesystem::path& file) const;
+	/* Maps the binary scene file into memory and copies the records out, defined in sceneBinary.cpp */
+	void loadFromBinary(const std::filesystem::path& file);
+	void saveToBinary(const std::filesystem::path& file) const;
+	/* Saves in the format given by the extension, like loadFromFile */
+	void saveToFile(const std::filesystem::path& file) const;
+	/*
+		Makes this space equal to the updated one, changing only what is different. Lines are compared
+		by their index, lines with the same geometry are kept in place and only their material is copied,
+		so only the returned lines need to be updated in anything that refers to them
+	*/
+	spaceChanges_t applyChanges(space_t&& updated);
+	/* Returns the index of the spawner closest to the point, if it is not further than maxDist. Points inside square and circle spawners have zero distance */
+	std::optional<size_t> getSpawnerAt(const vec2_t& point, extent_t maxDist) const;
+	/* Scales the spawner ratios so they add up to one and builds the spawner table and layers */
+	void normalizeSpawners();
+	/*
+		Moves the animated objects of this space to where they are at the frame, rest is the space the
+		animation belongs to and this space must be a copy of it. Only the animated objects are written,
+		polygons are transformed in place and only their bounding box is refit, so moving to the next
+		frame costs nothing for the objects that stay still
+	*/
+	void applyFrame(const space_t& rest, size_t frame);
 
 	inline void clear() {
 		size = vec2_t(0, 0);
 		objectHolder_t<line_t>::items.clear();
+		objectHolder_t<instance_t>::items.clear();
+		objectHolder_t<circle_t>::items.clear();
+		objectHolder_t<arc_t>::items.clear();
+		objectHolder_t<bezier_t>::items.clear();
+		objectHolder_t<polygon_t>::items.clear();
+		definitions.clear();
+		detectors.clear();
+		animation = animation_t();
 	}
 
 	inline space_t() : size(0, 0) {};
-};
\ No newline at end of file
+};
+
+/*
+	A space that is never modified once it is shared. Render workers keep the snapshot they
+	started with alive, so a new space can be swapped in while they are still reading the old one
+*/
+using spaceSnapshot_t = std::shared_ptr<const space_t>;
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "spaceLoader.h"
+#include "exceptions.h"
+
+void spaceLoader_t::load(const std::filesystem::path& path, spaceSnapshot_t base) {
+	auto& job = jobs.emplace_back(std::make_unique<job_t>());
+	job->generation = ++generation;
+	job->result.path = path;
+	job->result.isUpdate = base != nullptr;
+
+	job->thread = std::thread([job = job.get(), base = std::move(base)]() {
+		auto start = std::chrono::high_resolution_clock::now();
+		try {
+			auto space = std::make_shared<space_t>();
+			space->loadFromFile(job->result.path);
+			if (base) {
+				auto updated = std::make_shared<space_t>(*base);
+				job->result.changes = updated->applyChanges(std::move(*space));
+				space = std::move(updated);
+			}
+			job->result.space = std::move(space);
+		} catch (const except::config_ex & err) {
+			job->result.error = err.what();
+		} catch (const except::fileOpenFail_ex & err) {
+			job->result.error = err.what();
+		}
+		job->result.time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		job->done = true;
+	});
+}
+
+std::optional<spaceLoader_t::result_t> spaceLoader_t::poll() {
+	std::optional<result_t> latest;
+	auto iter = std::remove_if(jobs.begin(), jobs.end(), [this, &latest](std::unique_ptr<job_t>& job) {
+		if (job->done) {
+			job->thread.join();
+			if (job->generation == generation) latest = std::move(job->result);
+			return true;
+		} else return false;
+	});
+
+	if (iter != jobs.end()) jobs.erase(iter, jobs.end());
+	return latest;
+}
+
+void spaceLoader_t::waitAll() {
+	for (auto& job : jobs) {
+		if (job->thread.joinable()) job->thread.join();
+	}
+	jobs.clear();
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "pch.h"
+#include "space.h"
+
+/*
+	Loads spaces on background threads, so big rooms neither block the window nor the running
+	renders. Only the result of the latest load is reported, older loads that are still running
+	are discarded when they finish.
+*/
+class spaceLoader_t {
+public:
+	struct result_t {
+		std::filesystem::path path;
+		/* Null if the load failed */
+		spaceSnapshot_t space;
+		std::string error;
+		/* True for loads with a base */
+		bool isUpdate = false;
+		/* The changes to the base, only filled for updates */
+		spaceChanges_t changes;
+		/* Milliseconds spent loading, on the loading thread */
+		double time = 0;
+	};
+
+protected:
+	struct job_t {
+		std::thread thread;
+		std::atomic<bool> done = false;
+		size_t generation = 0;
+		result_t result;
+	};
+
+	std::vector<std::unique_ptr<job_t>> jobs;
+	size_t generation = 0;
+
+public:
+	/*
+		Starts loading the file. With a base the loaded space is applied to a copy of it using
+		space_t::applyChanges, so the changes are reported and the base stays untouched
+	*/
+	void load(const std::filesystem::path& path, spaceSnapshot_t base = nullptr);
+	/* Joins the finished loads, returns the result of the latest load once it finishes */
+	std::optional<result_t> poll();
+	/* Blocks until all loads finish, their results are discarded */
+	void waitAll();
+
+	inline bool isLoading() const { return !jobs.empty(); }
+
+	spaceLoader_t() = default;
+	spaceLoader_t(const spaceLoader_t&) = delete;
+	spaceLoader_t& operator=(const spaceLoader_t&) = delete;
+
+	inline ~spaceLoader_t() {
+		waitAll();
+	}
+};
@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "stats.h"
+#include "exceptions.h"
+
+renderStats_t& renderStats_t::operator+=(const renderStats_t& other) {
+	distanceQueries += other.distanceQueries;
+	marchSteps += other.marchSteps;
+	collisions += other.collisions;
+	killedByExit += other.killedByExit;
+	killedByIntensity += other.killedByIntensity;
+	killedByEmbedding += other.killedByEmbedding;
+	pixelsSplatted += other.pixelsSplatted;
+	photonsSpawned += other.photonsSpawned;
+	spawnTime += other.spawnTime;
+	cullTime += other.cullTime;
+	sortTime += other.sortTime;
+	marchTime += other.marchTime;
+	splatTime += other.splatTime;
+	detectTime += other.detectTime;
+	if (detectors.size() < other.detectors.size()) detectors.resize(other.detectors.size());
+	for (size_t i = 0, len = other.detectors.size(); i < len; i++) {
+		detectors[i] += other.detectors[i];
+	}
+	mergeTime += other.mergeTime;
+	// Wall time is not a sum, the controller sets it
+	return *this;
+}
+
+void renderStats_t::print() const {
+	auto perPhoton = [this](size_t value) {
+		return photonsSpawned == 0 ? 0.0 : (double)value / (double)photonsSpawned;
+	};
+
+	spdlog::info("Photons spawned:     {}", photonsSpawned);
+	spdlog::info("Distance queries:    {} ({:.2f} per photon)", distanceQueries, perPhoton(distanceQueries));
+	spdlog::info("March steps:         {} ({:.2f} per photon)", marchSteps, perPhoton(marchSteps));
+	spdlog::info("Collisions:          {} ({:.2f} per photon)", collisions, perPhoton(collisions));
+	spdlog::info("Killed by exit:      {}", killedByExit);
+	spdlog::info("Killed by intensity: {}", killedByIntensity);
+	spdlog::info("Killed by embedding: {}", killedByEmbedding);
+	spdlog::info("Pixels splatted:     {}", pixelsSplatted);
+	spdlog::info("Time [s]: spawn {:.3f}, cull {:.3f}, sort {:.3f}, march {:.3f}, splat {:.3f}, detect {:.3f}, merge {:.3f}, wall {:.3f}", spawnTime, cullTime, sortTime, marchTime, splatTime, detectTime, mergeTime, wallTime);
+	if (wallTime > 0) {
+		spdlog::info("{:.0f} photons/s, {:.0f} steps/s", (double)photonsSpawned / wallTime, (double)marchSteps / wallTime);
+	}
+	printDetectors();
+}
+
+void renderStats_t::printDetectors() const {
+	auto perPhoton = photonsSpawned == 0 ? 0.0 : 1 / (double)photonsSpawned;
+	for (auto& detector : detectors) {
+		spdlog::info("Detector {}: {} hits ({:.4f} per photon), energy [ {:.3f}, {:.3f}, {:.3f} ]", detector.name, detector.hits, (double)detector.hits * perPhoton, detector.energy.r, detector.energy.g, detector.energy.b);
+		if (!detector.histogram.empty()) {
+			std::string bins;
+			for (auto count : detector.histogram) bins += " " + std::to_string(count);
+			spdlog::info("  Hits by angle from -90 to 90 degrees:{}", bins);
+		}
+	}
+}
+
+nlohmann::json renderStats_t::toJson() const {
+	auto detectorsJson = nlohmann::json::array();
+	for (auto& detector : detectors) {
+		detectorsJson.push_back({
+			{ "name", detector.name },
+			{ "hits", detector.hits },
+			{ "energy", { detector.energy.r, detector.energy.g, detector.energy.b } },
+			{ "histogram", detector.histogram }
+		});
+	}
+
+	return {
+		{ "photonsSpawned", photonsSpawned },
+		{ "distanceQueries", distanceQueries },
+		{ "marchSteps", marchSteps },
+		{ "collisions", collisions },
+		{ "killed", {
+			{ "exit", killedByExit },
+			{ "intensity", killedByIntensity },
+			{ "embedding", killedByEmbedding }
+		} },
+		{ "pixelsSplatted", pixelsSplatted },
+		{ "detectors", detectorsJson },
+		{ "time", {
+			{ "spawn", spawnTime },
+			{ "cull", cullTime },
+			{ "sort", sortTime },
+			{ "march", marchTime },
+			{ "splat", splatTime },
+			{ "detect", detectTime },
+			{ "merge", mergeTime },
+			{ "wall", wallTime }
+		} }
+	};
+}
+
+void renderStats_t::writeJson(const std::filesystem::path& path) const {
+	std::ofstream file;
+	file.open(path);
+	if (file.fail()) {
+		throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+	}
+
+	file << toJson().dump(4);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "pch.h"
+#include "detector.h"
+
+/*
+	Counters collected during a render. Every worker has its own instance that only
+	it writes to, the controller adds them together when the worker finishes.
+*/
+struct renderStats_t {
+	/* Calls to getClosestShape */
+	size_t distanceQueries = 0;
+	/* The sum of photons alive in each step, a photon simulated for n steps is counted n times */
+	size_t marchSteps = 0;
+	size_t collisions = 0;
+	size_t killedByExit = 0;
+	size_t killedByIntensity = 0;
+	/* Photons stuck in a wall or inside a solid shape */
+	size_t killedByEmbedding = 0;
+	size_t pixelsSplatted = 0;
+	size_t photonsSpawned = 0;
+	/* The reading of every detector of the space, in their order */
+	std::vector<detectorReading_t> detectors;
+
+	/// Seconds spent in each stage, summed over all workers
+	double spawnTime = 0;
+	double cullTime = 0;
+	/* Time spent ordering the photons by their position */
+	double sortTime = 0;
+	double marchTime = 0;
+	double splatTime = 0;
+	/* Time spent testing the steps against the detectors */
+	double detectTime = 0;
+	/* Time spent adding the worker pixels together, on the controller thread */
+	double mergeTime = 0;
+	/* Time from the start of the render to the last worker finishing */
+	double wallTime = 0;
+
+	renderStats_t& operator+=(const renderStats_t& other);
+
+	void print() const;
+	/* Prints only the readings of the detectors, print() includes them */
+	void printDetectors() const;
+	nlohmann::json toJson() const;
+	void writeJson(const std::filesystem::path& path) const;
+};
+
+/* Measures the time since its creation and adds it to the target on destruction */
+struct statsTimer_t {
+	double& target;
+	std::chrono::steady_clock::time_point start;
+
+	inline statsTimer_t(double& target) : target(target), start(std::chrono::steady_clock::now()) {}
+	inline ~statsTimer_t() {
+		target += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};
@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "threadPool.h"
+
+void threadPool_t::run() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty()) return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+std::future<void> threadPool_t::submit(std::function<void()> task) {
+	// std::function must be copyable, so the packaged task is shared
+	auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+	auto future = packaged->get_future();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		tasks.emplace_back([packaged]() { (*packaged)(); });
+	}
+	available.notify_one();
+	return future;
+}
+
+threadPool_t& threadPool_t::getShared() {
+	static threadPool_t pool;
+	return pool;
+}
+
+threadPool_t::threadPool_t(size_t threadCount) {
+	if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 4;
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; i++) {
+		threads.emplace_back([this]() { run(); });
+	}
+}
+
+threadPool_t::~threadPool_t() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for (auto& thread : threads) thread.join();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "pch.h"
+
+/*
+	A fixed set of threads running the submitted tasks in order. The threads are started once and
+	reused, so starting a render does not create threads and a stopped render frees its threads
+	as soon as its tasks return.
+*/
+class threadPool_t {
+protected:
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping = false;
+
+	void run();
+
+public:
+	/* Queues the task, the returned future is ready when it returns and rethrows its exception */
+	std::future<void> submit(std::function<void()> task);
+
+	inline size_t getThreadCount() const { return threads.size(); }
+
+	/* The pool shared by the renders, with a thread for every hardware thread */
+	static threadPool_t& getShared();
+
+	/* Zero threads means one for every hardware thread */
+	explicit threadPool_t(size_t threadCount = 0);
+	threadPool_t(const threadPool_t&) = delete;
+	threadPool_t& operator=(const threadPool_t&) = delete;
+	/* Finishes the queued tasks before joining the threads */
+	~threadPool_t();
+};
@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "tiledImage.h"
+
+namespace {
+	constexpr size_t LOCK_COUNT = 64;
+	/* Numbers the files of the images, so every image has its own */
+	std::atomic<size_t> fileCount = 0;
+
+	inline Uint8 tonemap(extent_t value, extent_t multiplier) {
+		value = value * 255 * multiplier;
+		if (value >= 256) value = 255;
+		return (Uint8)value;
+	}
+}
+
+tiledImage_t::tiledImage_t(const std::filesystem::path& path, size_t width, size_t height) : path(path), width(width), height(height), locks(LOCK_COUNT) {
+	this->path += "." + std::to_string(fileCount++);
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	file.create(this->path, getTileCount() * TILE_PIXELS * sizeof(color_t));
+	written.resize(getTileCount());
+}
+
+tiledImage_t::~tiledImage_t() {
+	file.close();
+	std::error_code error;
+	std::filesystem::remove(path, error);
+}
+
+void tiledImage_t::addTile(size_t index, const color_t* source) {
+	auto target = (extent_t*)(file.getWritableData() + index * TILE_PIXELS * sizeof(color_t));
+	auto values = (const extent_t*)source;
+	std::unique_lock<std::mutex> lock(locks[index % LOCK_COUNT]);
+	for (size_t i = 0; i < TILE_PIXELS * 3; i++) {
+		target[i] += values[i];
+	}
+	written[index] = 1;
+}
+
+void tiledImage_t::addPixels(size_t index, const color_t* source, const std::vector<uint16_t>& pixels) {
+	auto target = (color_t*)(file.getWritableData() + index * TILE_PIXELS * sizeof(color_t));
+	std::unique_lock<std::mutex> lock(locks[index % LOCK_COUNT]);
+	for (auto pixel : pixels) {
+		target[pixel] = target[pixel] + source[pixel];
+	}
+	written[index] = 1;
+}
+
+void tiledImage_t::clear() {
+	// Pages of tiles never written are not touched, in a sparse file they take no space
+	for (size_t i = 0, len = written.size(); i < len; i++) {
+		if (!written[i]) continue;
+		std::memset(file.getWritableData() + i * TILE_PIXELS * sizeof(color_t), 0, TILE_PIXELS * sizeof(color_t));
+		written[i] = 0;
+	}
+}
+
+imageSource_t tiledImage_t::snapshot(std::shared_ptr<const tiledImage_t> image, extent_t multiplier) {
+	imageSource_t source;
+	source.width = image->width;
+	source.height = image->height;
+	// Shared by the copies of the source, so the image stays read until the last one is released
+	struct reader_t {
+		std::shared_ptr<const tiledImage_t> image;
+		inline reader_t(std::shared_ptr<const tiledImage_t> image) : image(std::move(image)) { this->image->readers++; }
+		inline ~reader_t() { image->readers--; }
+	};
+	source.fillRow = [reader = std::make_shared<reader_t>(std::move(image)), multiplier](size_t y, Uint8* row) {
+		auto& image = reader->image;
+		// The row is read one tile at a time, the part of the row in a tile is contiguous
+		auto tileRow = (y / TILE_SIZE) * image->tilesX;
+		auto offset = (y % TILE_SIZE) * TILE_SIZE;
+		for (size_t tileX = 0; tileX < image->tilesX; tileX++) {
+			auto pixels = image->getTile(tileRow + tileX) + offset;
+			auto start = tileX * TILE_SIZE;
+			auto count = std::min(TILE_SIZE, image->width - start);
+			for (size_t x = 0; x < count; x++) {
+				auto target = row + (start + x) * 3;
+				target[0] = tonemap(pixels[x].r, multiplier);
+				target[1] = tonemap(pixels[x].g, multiplier);
+				target[2] = tonemap(pixels[x].b, multiplier);
+			}
+		}
+	};
+	return source;
+}
+
+tileCache_t::tileCache_t(tiledImage_t& image, size_t capacity) : image(image), capacity(std::max(capacity, (size_t)1)), entryOfTile(image.getTileCount(), NO_ENTRY) {
+	entries.reserve(this->capacity);
+}
+
+tileCache_t::entry_t& tileCache_t::load(size_t tile) {
+	uses++;
+	if (entryOfTile[tile] != NO_ENTRY) {
+		auto& entry = entries[entryOfTile[tile]];
+		entry.lastUse = uses;
+		return entry;
+	}
+
+	size_t index;
+	if (entries.size() < capacity) {
+		index = entries.size();
+		auto& entry = entries.emplace_back();
+		entry.pixels.resize(tiledImage_t::TILE_PIXELS);
+	} else {
+		// Writing back the least recently used tile, its buffer is reused for the new one
+		index = 0;
+		for (size_t i = 1, len = entries.size(); i < len; i++) {
+			if (entries[i].lastUse < entries[index].lastUse) index = i;
+		}
+		writeBack(entries[index]);
+		entryOfTile[entries[index].tile] = NO_ENTRY;
+	}
+	auto& entry = entries[index];
+	entry.tile = tile;
+	entry.lastUse = uses;
+	entryOfTile[tile] = (uint32_t)index;
+	return entry;
+}
+
+void tileCache_t::writeBack(entry_t& entry) {
+	if (entry.drawn.empty()) return;
+	// Past a quarter of the tile the whole tile is added, it is faster than jumping around the listed pixels
+	if (entry.drawn.size() < tiledImage_t::TILE_PIXELS / 4) {
+		image.addPixels(entry.tile, entry.pixels.data(), entry.drawn);
+		for (auto pixel : entry.drawn) entry.pixels[pixel] = color_t();
+	} else {
+		image.addTile(entry.tile, entry.pixels.data());
+		std::fill(entry.pixels.begin(), entry.pixels.end(), color_t());
+	}
+	entry.drawn.clear();
+	entry.isDrawn.reset();
+}
+
+void tileCache_t::flush() {
+	for (auto& entry : entries) {
+		writeBack(entry);
+		entryOfTile[entry.tile] = NO_ENTRY;
+	}
+	entries.clear();
+	lastTile = SIZE_MAX;
+	lastEntry = nullptr;
+}
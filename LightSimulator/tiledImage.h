@@ -0,0 +1,127 @@
+#pragma once
+#include "pch.h"
+#include "vectors.h"
+#include "mappedFile.h"
+#include "pngEncoder.h"
+
+/*
+	Image accumulated in a memory mapped file instead of memory, so its size is limited by the disk.
+	The pixels are stored in square tiles of TILE_SIZE pixels, every tile is contiguous in the file,
+	so the pages a worker touches while drawing a photon are few and close together. The workers do
+	not draw into the file directly, they draw into a tileCache_t and add the tiles to the file when
+	they are evicted.
+*/
+class tiledImage_t {
+protected:
+	mappedFile_t file;
+	std::filesystem::path path;
+	size_t width;
+	size_t height;
+	size_t tilesX;
+	size_t tilesY;
+	/* Tiles are added under the lock of their index modulo the count, so workers evicting different tiles rarely wait */
+	std::vector<std::mutex> locks;
+	/* Set for the tiles added since the last clear, the other tiles are still zero */
+	std::vector<Uint8> written;
+	/* The amount of snapshots still reading the file */
+	mutable std::atomic<size_t> readers = 0;
+
+public:
+	static constexpr size_t TILE_SIZE = 64;
+	static constexpr size_t TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+	inline size_t getWidth() const { return width; }
+	inline size_t getHeight() const { return height; }
+	inline size_t getTilesX() const { return tilesX; }
+	inline size_t getTileCount() const { return tilesX * tilesY; }
+	/* The file of the image, the path it was created with and a number unique to the image */
+	inline const std::filesystem::path& getPath() const { return path; }
+	/* True while a snapshot of the image is in use, clearing it would change the saved image */
+	inline bool isRead() const { return readers > 0; }
+
+	inline size_t getTileIndex(size_t x, size_t y) const {
+		return (y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+	}
+
+	inline const color_t* getTile(size_t index) const {
+		return (const color_t*)file.getData() + index * TILE_PIXELS;
+	}
+
+	inline const color_t& getPixel(size_t x, size_t y) const {
+		return getTile(getTileIndex(x, y))[(y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+	}
+
+	/* Adds the pixels of a tile to the image, safe to call from multiple threads at once */
+	void addTile(size_t index, const color_t* source);
+	/* Adds only the listed pixels of the tile, for tiles with few pixels drawn */
+	void addPixels(size_t index, const color_t* source, const std::vector<uint16_t>& pixels);
+	/* Sets all pixels to zero, must not be called while a worker draws into the image or while it isRead() */
+	void clear();
+	/*
+		Tonemaps the rows straight from the file, the image is not copied. The source keeps the image
+		alive and marks it read until it is released, renders still running change the rows it reads
+	*/
+	static imageSource_t snapshot(std::shared_ptr<const tiledImage_t> image, extent_t multiplier);
+
+	/*
+		Creates an image of the size in a new file named after the path, so an image released later
+		never deletes the file of a newer one. Throws except::fileOpenFail_ex if it cannot be created
+	*/
+	tiledImage_t(const std::filesystem::path& path, size_t width, size_t height);
+	tiledImage_t(const tiledImage_t&) = delete;
+	tiledImage_t& operator=(const tiledImage_t&) = delete;
+	/* The file is only storage for the render, it is deleted with the image */
+	~tiledImage_t();
+};
+
+/* The tiles of a tiled image one worker draws into, a bounded amount kept in memory. The least recently used tile is added to the image to make space */
+class tileCache_t {
+protected:
+	struct entry_t {
+		size_t tile;
+		size_t lastUse;
+		std::vector<color_t> pixels;
+		/* The pixels drawn, in the order they were first drawn. A line crosses a tile in a few pixels, so evicting a tile only adds those */
+		std::vector<uint16_t> drawn;
+		std::bitset<tiledImage_t::TILE_PIXELS> isDrawn;
+	};
+
+	tiledImage_t& image;
+	entry_t* lastEntry = nullptr;
+	size_t capacity;
+	std::vector<entry_t> entries;
+	/* The entry of every tile of the image, or NO_ENTRY */
+	std::vector<uint32_t> entryOfTile;
+	size_t uses = 0;
+	/* The tile of the last pixel drawn, the pixels of a line are mostly in the same tile */
+	size_t lastTile = SIZE_MAX;
+
+	static constexpr uint32_t NO_ENTRY = 0xFFFFFFFF;
+
+	/* Returns the cached tile, evicting a tile if the cache is full */
+	entry_t& load(size_t tile);
+	/* Adds the tile to the image and zeroes it */
+	void writeBack(entry_t& entry);
+
+public:
+	inline void add(size_t x, size_t y, const color_t& color) {
+		auto tile = image.getTileIndex(x, y);
+		if (tile != lastTile) {
+			lastEntry = &load(tile);
+			lastTile = tile;
+		}
+		auto index = (y % tiledImage_t::TILE_SIZE) * tiledImage_t::TILE_SIZE + x % tiledImage_t::TILE_SIZE;
+		if (!lastEntry->isDrawn[index]) {
+			lastEntry->isDrawn[index] = true;
+			lastEntry->drawn.push_back((uint16_t)index);
+		}
+		auto& pixel = lastEntry->pixels[index];
+		pixel = pixel + color;
+	}
+
+	/* Adds all cached tiles to the image and empties the cache */
+	void flush();
+
+	/* The capacity is the amount of tiles kept in memory */
+	tileCache_t(tiledImage_t& image, size_t capacity);
+};
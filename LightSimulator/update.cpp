@@ -2,17 +2,142 @@
 #include "update.h"
 #include "exceptions.h"
 #include "rendering.h"
+#include "fileWatcher.h"
+#include "spaceLoader.h"
+#include "jobServer.h"
 
 constexpr char WINDOW_TITLE[] = "Light Simulator ";
+/* The screen is redrawn at most this often, no matter how often the event loop runs */
+constexpr auto FRAME_INTERVAL = std::chrono::milliseconds(33);
+/* The time a live pass should take, the photons of the next pass are adjusted to it */
+constexpr double LIVE_PASS_TIME = 0.05;
+/* Photons of the first live pass, the live image is shown as if this amount was simulated */
+constexpr size_t LIVE_START_PHOTONS = 20000;
+constexpr size_t LIVE_MIN_PHOTONS = 1000;
+constexpr size_t LIVE_MAX_PHOTONS = 1000000;
+/* Live passes render at this fraction of the resolution */
+constexpr double LIVE_RESOLUTION_SCALE = 0.5;
+/* How far from a spawner a right click can be to start dragging it, in pixels */
+constexpr extent_t DRAG_DISTANCE = 8;
 
-void update(space_t& space) {
+/* True if the command is the word alone or followed by a space and arguments, so words do not take over commands like s<path> whose argument starts with them */
+static bool isCommand(const std::string& command, const std::string& word) {
+	return command.compare(0, word.length(), word) == 0 && (command.length() == word.length() || command[word.length()] == ' ');
+}
+
+void update(spaceSnapshot_t space) {
 	std::atomic<bool>* threadActive = nullptr;
 	std::deque<std::string> commands;
 	std::mutex commandsMutex;
 	std::filesystem::path lastOpenFile;
 	batchController_t controller;
+	pngEncoder_t encoder;
 	bool screenDirty = true;
 	double pixelsPerUnit = 10;
+	/* When not empty, the render statistics are written to this file after every render */
+	std::filesystem::path statsPath;
+	bool wasRendering = false;
+	/* Watches the open file in watch mode, a change stops the running render because its image would mix both spaces */
+	fileWatcher_t watcher;
+	/* Loads the spaces off the event loop */
+	spaceLoader_t loader;
+	/* Renders the jobs of scripts in the background, next to the renders started by commands */
+	jobServer_t server;
+	/* In live mode small passes are rendered one after another into the same image, which is cleared when the space changes */
+	bool live = false;
+	size_t livePhotons = LIVE_START_PHOTONS;
+	auto nextFrame = std::chrono::high_resolution_clock::now();
+	/* The spawner dragged with the right mouse button */
+	std::optional<size_t> draggedSpawner;
+	/* The offset of the dragged spawner from the mouse */
+	vec2_t dragOffset;
+	/* Where the dragged spawner should be moved, the space is replaced once per loop no matter how many motion events came */
+	std::optional<vec2_t> dragTarget;
+	/* The frames of an animation rendered one after another into the same image, each is saved when it finishes */
+	struct sequence_t {
+		/* The space the animation belongs to, the frames are made from it */
+		spaceSnapshot_t rest;
+		/* The space of the frame being rendered, reused for the next frame once no worker holds it */
+		std::shared_ptr<space_t> frameSpace;
+		size_t frame = 0;
+		size_t photons = 0;
+		std::string prefix;
+	};
+	std::optional<sequence_t> sequence;
+
+	/* Cancels the running render, the workers return after their current step */
+	auto stopRendering = [&](const char* reason) {
+		if (sequence) {
+			spdlog::info("Sequence stopped at frame {}", sequence->frame);
+			sequence.reset();
+		}
+		if (controller.cancel()) {
+			wasRendering = false;
+			// Live passes are restarted all the time, there is no point in reporting it
+			if (!live) spdlog::info("Render stopped, {}", reason);
+		}
+	};
+
+	auto setLive = [&](bool value) {
+		if (live == value) return;
+		if (value) {
+			stopRendering("live mode started");
+			live = true;
+			livePhotons = LIVE_START_PHOTONS;
+			controller.clear();
+			controller.setExposurePhotons(LIVE_START_PHOTONS);
+			spdlog::info("Live mode started");
+		} else {
+			stopRendering("live mode stopped");
+			live = false;
+			controller.setExposurePhotons(0);
+			spdlog::info("Live mode stopped");
+		}
+	};
+
+	/* Sizes the image for the shown part of the space, the whole space or the region of interest. Returns false if the tiled image could not be created */
+	auto resizeImage = [&](const space_t& shown, double scale) {
+		auto size = controller.getRegion(shown).size * (pixelsPerUnit * scale);
+		try {
+			controller.resize((size_t)std::ceil(size.x), (size_t)std::ceil(size.y));
+			return true;
+		} catch (const except::fileOpenFail_ex & err) {
+			spdlog::error(err.what());
+			return false;
+		}
+	};
+
+	auto startSequenceFrame = [&]() {
+		auto& rest = *sequence->rest;
+		// Only the animated objects are written, the rest of the space is the copy made for the first frame
+		if (!sequence->frameSpace || sequence->frameSpace.use_count() > 1) sequence->frameSpace = std::make_shared<space_t>(rest);
+		sequence->frameSpace->applyFrame(rest, sequence->frame);
+		resizeImage(rest, 1);
+		controller.clear();
+		controller.startRendering(sequence->frameSpace, sequence->photons);
+		screenDirty = true;
+	};
+
+	/* Set when a failed replay should clear the image, because the image no longer matches the space */
+	bool clearIfReplayFails = false;
+	/*
+		Starts drawing the recorded paths, or the ones of the file, at the current resolution instead of simulating them.
+		The image is replaced once the replay finishes in the background. Returns false if the replay could not be started
+	*/
+	auto redraw = [&](const std::filesystem::path& path, bool clearIfFailed = false) {
+		auto size = controller.getRegion(*space).size * (pixelsPerUnit * (live ? LIVE_RESOLUTION_SCALE : 1.0));
+		auto width = (size_t)std::ceil(size.x);
+		auto height = (size_t)std::ceil(size.y);
+		try {
+			if (path.empty()) controller.startReplay(space, width, height);
+			else controller.startReplay(path, space, width, height);
+			clearIfReplayFails = clearIfFailed;
+			return true;
+		} catch (const std::runtime_error & err) {
+			spdlog::error(err.what());
+			return false;
+		}
+	};
 
 	auto commandThread = std::thread([&]() {
 		auto uniqueThreadActive = std::make_unique<std::atomic<bool>>(true);
@@ -56,48 +181,382 @@ void update(space_t& space) {
 				}
 			} else if (event.type == SDL_MOUSEMOTION) {
 				screenDirty = true;
+				if (draggedSpawner) {
+					dragTarget = space->getView(surface->w, surface->h).screenToLocal(SDL_Point{ event.motion.x, event.motion.y }) + dragOffset;
+				}
+			} else if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_RIGHT) {
+				auto view = space->getView(surface->w, surface->h);
+				auto point = view.screenToLocal(SDL_Point{ event.button.x, event.button.y });
+				draggedSpawner = space->getSpawnerAt(point, DRAG_DISTANCE / view.zoom);
+				if (draggedSpawner) dragOffset = space->spawners[*draggedSpawner].pos - point;
+			} else if (event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_RIGHT) {
+				if (draggedSpawner && *draggedSpawner < space->spawners.size()) {
+					auto& pos = space->spawners[*draggedSpawner].pos;
+					spdlog::info("Spawner {} moved to [ {}, {} ]", *draggedSpawner, pos.x, pos.y);
+				}
+				draggedSpawner.reset();
 			}
 		}
+		// Moving the dragged spawner, the space is copied because the renders may still read the current one
+		if (dragTarget) {
+			if (draggedSpawner && *draggedSpawner < space->spawners.size()) {
+				auto moved = std::make_shared<space_t>(*space);
+				moved->spawners[*draggedSpawner].pos = *dragTarget;
+				space = std::move(moved);
+				stopRendering("a spawner was moved");
+				controller.clear();
+				screenDirty = true;
+			}
+			dragTarget.reset();
+		}
 		// Updating the batch controller, if there is any
 		if (!controller.isDone()) {
 			// The title is set to display the percentage of photons done
-			SDL_SetWindowTitle(window.get(), (WINDOW_TITLE + std::to_string(controller.update() * 100) + "%").c_str());
+			auto progress = std::to_string(controller.update() * 100) + "%";
+			if (sequence) progress = "frame " + std::to_string(sequence->frame + 1) + "/" + std::to_string(sequence->rest->animation.frames) + " " + progress;
+			SDL_SetWindowTitle(window.get(), (WINDOW_TITLE + progress).c_str());
+			wasRendering = true;
 		} else {
 			SDL_SetWindowTitle(window.get(), WINDOW_TITLE);
+			if (wasRendering && live) {
+				wasRendering = false;
+				// The next pass takes about LIVE_PASS_TIME, the budget changes at most twice per pass so a short cancelled pass does not make it jump
+				auto wallTime = controller.getStats().wallTime;
+				auto factor = wallTime > 0 ? std::min(LIVE_PASS_TIME / wallTime, 2.0) : 2.0;
+				livePhotons = std::clamp((size_t)((double)livePhotons * std::max(factor, 0.5)), LIVE_MIN_PHOTONS, LIVE_MAX_PHOTONS);
+			} else if (wasRendering && sequence) {
+				wasRendering = false;
+				// The frame is encoded in the background while the next one renders
+				auto number = std::to_string(sequence->frame);
+				auto path = sequence->prefix + std::string(number.size() < 4 ? 4 - number.size() : 0, '0') + number + ".png";
+				encoder.save(controller.snapshot(), path);
+				spdlog::info("Frame {} done in {:.3f} s", sequence->frame, controller.getStats().wallTime);
+				sequence->frame++;
+				if (sequence->frame < sequence->rest->animation.frames) {
+					startSequenceFrame();
+				} else {
+					spdlog::info("Sequence done, {} frames", sequence->frame);
+					sequence.reset();
+				}
+			} else if (wasRendering) {
+				wasRendering = false;
+				spdlog::info("Rendering done in {:.3f} s", controller.getStats().wallTime);
+				if (controller.isDetectorOnly()) controller.getStats().printDetectors();
+				if (!statsPath.empty()) {
+					try {
+						controller.getStats().writeJson(statsPath);
+					} catch (const except::fileOpenFail_ex & err) {
+						spdlog::error(err.what());
+					}
+				}
+			}
+		}
+		// Starting the next live pass, the pixels of the passes add up until the image is cleared
+		if (live && controller.isDone() && !controller.isReplaying() && space->size.x != 0 && space->size.y != 0) {
+			if (resizeImage(*space, LIVE_RESOLUTION_SCALE)) controller.startRendering(space, livePhotons);
+			else setLive(false);
+		}
+		// Joining the finished saves
+		encoder.update();
+		// Swapping in the replayed image
+		try {
+			if (auto result = controller.pollReplay()) {
+				spdlog::info("Replayed {} photons with {} vertices in {:.2f} ms", result->photons, result->vertices, result->time * 1000);
+				screenDirty = true;
+			}
+		} catch (const std::runtime_error & err) {
+			spdlog::error(err.what());
+			if (clearIfReplayFails) controller.clear();
+		}
+		// Applying the changes of the watched file
+		if (watcher.poll()) loader.load(watcher.getPath(), space);
+		// Swapping in the loaded space
+		if (auto result = loader.poll()) {
+			if (result->isUpdate) {
+				if (!result->space) {
+					// The loaded space is kept, so a half written file does not discard it
+					spdlog::error(result->error);
+				} else if (result->changes.isEmpty()) {
+					spdlog::info("File changed, but the space is the same");
+				} else {
+					auto& changes = result->changes;
+					spdlog::info("Applied changes in {:.2f} ms, {} lines with changed geometry, {} with changed material, {} removed{}{}{}{}{}{}",
+						result->time,
+						changes.changedGeometry.size(), changes.changedMaterial.size(), changes.removedLines,
+						changes.spawnersChanged ? ", spawners changed" : "",
+						changes.instancesChanged ? ", instances changed" : "",
+						changes.curvesChanged ? ", curves changed" : "",
+						changes.polygonsChanged ? ", polygons changed" : "",
+						changes.animationChanged ? ", animation changed" : "",
+						changes.detectorsChanged ? ", detectors changed" : ""
+					);
+					space = std::move(result->space);
+					stopRendering("the space changed");
+					screenDirty = true;
+					// When only reflectivities changed the recorded paths are drawn with the new ones
+					if (!changes.isMaterialOnly() || !controller.hasRecording() || !redraw("", true)) controller.clear();
+				}
+			} else {
+				if (result->space) {
+					space = std::move(result->space);
+					spdlog::info("Loaded space from file in {:.2f} ms", result->time);
+					lastOpenFile = result->path;
+					if (watcher.isWatching()) {
+						try {
+							watcher.watch(result->path);
+						} catch (const std::runtime_error & err) {
+							spdlog::error(err.what());
+						}
+					}
+				} else {
+					spdlog::error(result->error);
+					space = std::make_shared<const space_t>();
+				}
+				stopRendering("a new space was loaded");
+				screenDirty = true;
+				controller.clear();
+			}
 		}
 		// Listening to commands
 		{
 			// The command queue is on a another thread
 			std::unique_lock<std::mutex> lock(commandsMutex);
 
-			auto loadFileOnPath = [&](const std::filesystem::path& path) {
-				try {
-					space.loadFromFile(path);
-					spdlog::info("Loaded space from file");
-					lastOpenFile = path;
-				} catch (const except::config_ex & err) {
-					spdlog::error(err.what());
-					space.clear();
-				} catch (const except::fileOpenFail_ex & err) {
-					spdlog::error(err.what());
-					space.clear();
-				}
-				screenDirty = true;
-				controller.clear();
-			};
-
 			while (!commands.empty()) {
 				auto command = commands.front();
 				commands.pop_front();
 				if (command[0] == 'o') {
 					auto path = std::filesystem::path(command.substr(1));
 
-					loadFileOnPath(path);
+					// The space is swapped in when the load finishes
+					loader.load(path);
 				} else if (command == "r") {
 					if (!lastOpenFile.empty()) {
-						loadFileOnPath(lastOpenFile);
+						loader.load(lastOpenFile);
+					} else {
+						spdlog::error("No file was opened");
+					}
+				} else if (isCommand(command, "stats")) {
+					if (command.length() > 5) {
+						auto path = command.substr(6);
+						if (path == "-") statsPath.clear();
+						else statsPath = path;
+					} else {
+						if (!controller.isDone()) spdlog::info("Rendering, only finished workers are included");
+						controller.getStats().print();
+					}
+					if (!statsPath.empty()) spdlog::info("Statistics are written to {} after every render", statsPath.string());
+				} else if (isCommand(command, "heatmap")) {
+					auto mode = command.length() > 7 ? command.substr(8) : "";
+					if (mode.empty()) {
+						if (!controller.hasHeatmap()) spdlog::error("No heatmap was collected, use heatmap steps or heatmap queries before rendering");
+						else controller.setShowHeatmap(!controller.isShowingHeatmap());
+					} else if (mode == "steps" || mode == "queries") {
+						controller.setHeatmapMode(mode == "steps" ? heatmapMode_e::steps : heatmapMode_e::queries);
+						controller.setShowHeatmap(true);
+						spdlog::info("Collecting {} per pixel in the following renders", mode);
+					} else if (mode == "off") {
+						controller.setHeatmapMode(heatmapMode_e::off);
+						controller.setShowHeatmap(false);
+					} else {
+						spdlog::error("Unknown heatmap mode, expected steps, queries or off");
+					}
+				} else if (isCommand(command, "serve")) {
+					if (command.length() > 5) {
+						try {
+							server.start(command.substr(6));
+							spdlog::info("Accepting render jobs on {}", server.getPath().string());
+						} catch (const std::runtime_error & err) {
+							spdlog::error(err.what());
+						}
+					} else if (server.isRunning()) {
+						server.stop();
+						spdlog::info("Stopped accepting render jobs");
+					} else {
+						spdlog::error("Expected serve <socket path>");
+					}
+				} else if (isCommand(command, "sequence")) {
+					auto arguments = command.length() > 8 ? command.substr(9) : "";
+					auto separator = arguments.find(' ');
+					long long photons = 0;
+					try {
+						photons = std::stoll(arguments.substr(0, separator));
+					} catch (const std::logic_error&) {
+						photons = 0;
+					}
+					if (separator == std::string::npos || photons <= 0) spdlog::error("Expected sequence <photons> <output prefix>");
+					else if (space->animation.isEmpty()) spdlog::error("The space is not animated");
+					else if (space->size.x == 0 || space->size.y == 0) spdlog::error("Cannot render empty space");
+					// The frames are saved while the next one renders, they need their own copy of the image
+					else if (controller.isTiled()) spdlog::error("Sequences cannot be rendered into a tiled image");
+					else {
+						setLive(false);
+						stopRendering("a sequence was started");
+						sequence = sequence_t{ space, nullptr, 0, (size_t)photons, arguments.substr(separator + 1) };
+						spdlog::info("Rendering {} frames of {} photons", space->animation.frames, photons);
+						startSequenceFrame();
+					}
+				} else if (command == "layers") {
+					controller.setLayered(!controller.isLayered());
+					if (controller.isLayered()) spdlog::info("The following renders keep every spawner or light group in its own layer");
+					else spdlog::info("The following renders draw into the image directly");
+				} else if (command == "detect") {
+					controller.setDetectorOnly(!controller.isDetectorOnly());
+					if (controller.isDetectorOnly()) spdlog::info("The following renders only measure the detectors, {} in the space", space->detectors.size());
+					else spdlog::info("The following renders draw the image");
+				} else if (isCommand(command, "sort")) {
+					std::istringstream arguments(command.substr(4));
+					long long interval = -1;
+					if (command.length() == 4) {
+						if (controller.getSortInterval() == 0) spdlog::info("The photons are not sorted");
+						else spdlog::info("The photons are sorted by their position every {} steps", controller.getSortInterval());
+					} else if (!(arguments >> interval) || !(arguments >> std::ws).eof() || interval < 0) {
+						spdlog::error("Expected sort <steps>");
 					} else {
+						controller.setSortInterval((size_t)interval);
+						if (interval == 0) spdlog::info("The following renders do not sort the photons");
+						else spdlog::info("The following renders sort the photons by their position every {} steps", interval);
+					}
+				} else if (isCommand(command, "relight")) {
+					auto& names = controller.getLayerNames();
+					std::istringstream arguments(command.substr(7));
+					std::string layerName;
+					std::vector<extent_t> numbers;
+					arguments >> layerName;
+					for (extent_t number; arguments >> number;) numbers.push_back(number);
+
+					if (names.empty()) {
+						spdlog::error("The image has no layers, use layers and render first");
+					} else if (layerName.empty()) {
+						auto& lights = controller.getLayerLights();
+						for (size_t i = 0, len = names.size(); i < len; i++) {
+							spdlog::info("Layer {} {}: color [ {}, {}, {} ], weight {}", i, names[i], lights[i].color.r, lights[i].color.g, lights[i].color.b, lights[i].weight);
+						}
+					} else {
+						// Layers are given by their index or by the name of their group
+						std::optional<size_t> layer;
+						auto named = std::find(names.begin(), names.end(), layerName);
+						if (named != names.end()) layer = named - names.begin();
+						else {
+							size_t index;
+							auto end = layerName.data() + layerName.size();
+							auto [last, error] = std::from_chars(layerName.data(), end, index);
+							if (error == std::errc() && last == end && index < names.size()) layer = index;
+						}
+
+						if (!layer) spdlog::error("No layer {}", layerName);
+						else if (!arguments.eof() || (numbers.size() != 1 && numbers.size() != 3 && numbers.size() != 4)) spdlog::error("Expected relight <layer> <weight> or relight <layer> <r> <g> <b> [weight]");
+						else {
+							auto light = controller.getLayerLights()[*layer];
+							if (numbers.size() == 1) light.weight = numbers[0];
+							else light.color = color_t(numbers[0], numbers[1], numbers[2]);
+							if (numbers.size() == 4) light.weight = numbers[3];
+							auto relightStart = std::chrono::high_resolution_clock::now();
+							controller.setLayerLight(*layer, light);
+							spdlog::info("Relit in {:.2f} ms", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - relightStart).count());
+						}
+					}
+				} else if (isCommand(command, "record")) {
+					if (command.length() > 6) {
+						// The image starts over, so it only contains recorded photons
+						stopRendering("the recording was started");
+						controller.setRecordPath(command.substr(7));
+						controller.clear();
+						spdlog::info("Recording the paths of the following renders to {}", controller.getRecordPath().string());
+					} else if (!controller.getRecordPath().empty()) {
+						controller.setRecordPath("");
+						spdlog::info("Stopped recording");
+					} else {
+						spdlog::error("Expected record <path>");
+					}
+				} else if (isCommand(command, "tiled")) {
+					try {
+						if (command.length() > 5) {
+							stopRendering("the image is tiled");
+							controller.setTiledPath(command.substr(6));
+							spdlog::info("The image is accumulated in tiles in {}", controller.getTiledPath().string());
+						} else if (controller.isTiled()) {
+							stopRendering("the image is kept in memory");
+							controller.setTiledPath("");
+							spdlog::info("The image is kept in memory");
+						} else {
+							spdlog::error("Expected tiled <path>");
+						}
+					} catch (const except::fileOpenFail_ex & err) {
+						spdlog::error(err.what());
+						controller.setTiledPath("");
+					}
+					screenDirty = true;
+				} else if (isCommand(command, "roi")) {
+					std::istringstream arguments(command.substr(3));
+					std::vector<extent_t> numbers;
+					for (extent_t number; arguments >> number;) numbers.push_back(number);
+
+					std::optional<std::optional<region_t>> region;
+					if (numbers.empty()) {
+						if (controller.getRegion()) region.emplace(std::nullopt);
+						else spdlog::info("The renders draw the whole space");
+					} else if (!arguments.eof() || (numbers.size() != 4 && numbers.size() != 5)) {
+						spdlog::error("Expected roi <x> <y> <width> <height> [pixels per unit]");
+					} else if (numbers[2] <= 0 || numbers[3] <= 0 || (numbers.size() == 5 && numbers[4] <= 0)) {
+						spdlog::error("The size of the region and the pixels per unit must be greater than zero");
+					} else {
+						region.emplace(region_t{ vec2_t(numbers[0], numbers[1]), vec2_t(numbers[2], numbers[3]) });
+					}
+
+					if (region) {
+						stopRendering("the region of interest changed");
+						controller.setRegion(*region);
+						if (numbers.size() == 5) pixelsPerUnit = numbers[4];
+						if (*region) {
+							auto size = (*region)->size * pixelsPerUnit;
+							spdlog::info("The following renders draw [ {}, {} ] to [ {}, {} ] into {}x{} pixels", numbers[0], numbers[1], numbers[0] + numbers[2], numbers[1] + numbers[3], std::ceil(size.x), std::ceil(size.y));
+						} else spdlog::info("The following renders draw the whole space");
+						// The recorded photons cover the whole space, so the new region can be drawn from them
+						if (controller.hasRecording() && space->size.x != 0 && space->size.y != 0) redraw("");
+						else controller.clear();
+						screenDirty = true;
+					}
+				} else if (isCommand(command, "replay")) {
+					if (space->size.x == 0 || space->size.y == 0) spdlog::error("Cannot replay in empty space");
+					else {
+						stopRendering("the paths are replayed");
+						redraw(command.length() > 6 ? command.substr(7) : "");
+					}
+				} else if (command == "live") {
+					setLive(!live);
+				} else if (command == "stop") {
+					if (controller.isDone()) spdlog::error("Not rendering");
+					else stopRendering("the image contains the photons simulated so far");
+				} else if (command == "watch") {
+					if (watcher.isWatching()) {
+						watcher.stop();
+						spdlog::info("Stopped watching {}", lastOpenFile.string());
+					} else if (lastOpenFile.empty()) {
 						spdlog::error("No file was opened");
+					} else {
+						try {
+							watcher.watch(lastOpenFile);
+							spdlog::info("Watching {}", lastOpenFile.string());
+						} catch (const std::runtime_error & err) {
+							spdlog::error(err.what());
+						}
+					}
+				} else if (command.rfind("convert ", 0) == 0) {
+					auto arguments = command.substr(8);
+					auto separator = arguments.find(' ');
+					if (separator == std::string::npos) spdlog::error("Expected convert <input> <output>");
+					else {
+						auto input = std::filesystem::path(arguments.substr(0, separator));
+						auto output = std::filesystem::path(arguments.substr(separator + 1));
+						try {
+							space_t converted;
+							converted.loadFromFile(input);
+							converted.saveToFile(output);
+							spdlog::info("Converted {} to {}", input.string(), output.string());
+						} catch (const std::exception & err) {
+							spdlog::error(err.what());
+						}
 					}
 				} else if (command == "q") {
 					goto eventLoopExit;
@@ -111,20 +570,13 @@ void update(space_t& space) {
 						number = 0;
 					}
 					if (number != 0) {
-						if (!controller.isDone()) {
-							spdlog::error("Currently rendering");
-						} else {
-							if (space.size.x == 0 || space.size.y == 0) spdlog::error("Cannot render empty space");
-							else {
-								spdlog::info("Preparing to render {} photons", number);
+						if (space->size.x == 0 || space->size.y == 0) spdlog::error("Cannot render empty space");
+						else {
+							setLive(false);
+							stopRendering("a new render was started");
+							spdlog::info("Preparing to render {} photons", number);
 
-								controller.resize(
-									(size_t)std::ceil(space.size.x * pixelsPerUnit),
-									(size_t)std::ceil(space.size.y * pixelsPerUnit)
-								);
-
-								controller.startRendering(space, number);
-							}
+							if (resizeImage(*space, 1)) controller.startRendering(space, number);
 						}
 					} else spdlog::error("Invalid number");
 				} else if (command[0] == '*') {
@@ -137,7 +589,12 @@ void update(space_t& space) {
 						number = 0;
 					}
 					if (number != 0) {
-						pixelsPerUnit = number;
+						if (number != pixelsPerUnit) {
+							stopRendering("the resolution changed");
+							pixelsPerUnit = number;
+							// The recorded photons are drawn again at the new resolution
+							if (controller.hasRecording() && space->size.x != 0 && space->size.y != 0) redraw("");
+						}
 					} else spdlog::error("Invalid number");
 				} else if (command[0] == 'm') {
 					if (command.length() == 1) {
@@ -165,17 +622,30 @@ void update(space_t& space) {
 					}
 					spdlog::info("{}", std::filesystem::current_path().string());
 				} else if (command[0] == 's') {
-					if (space.size.x == 0 || space.size.y == 0) spdlog::error("Cannot save empty space");
+					if (space->size.x == 0 || space->size.y == 0) spdlog::error("Cannot save empty space");
 					else {
 						auto path = command.substr(1);
-						auto surface = controller.draw(0, 0);
-
+						// The image is encoded in the background, only the copy of the pixels is made here
+						encoder.save(controller.snapshot(), path);
+						if (controller.hasHeatmap()) {
+							auto heatmapPath = std::filesystem::path(path);
+							heatmapPath.replace_extension(".heat.png");
+							encoder.save(controller.snapshotHeatmap(), heatmapPath);
+						}
+					}
+				} else if (command[0] == 'z') {
+					if (command.length() == 1) {
+						spdlog::info(encoder.getCompressionLevel());
+					} else {
+						int number = -1;
 						try {
-							IMG_SavePNG(surface.get(), path.c_str());
-							spdlog::info("File saved");
-						} catch (const sdlhelp::SDLException & err) {
-							spdlog::error("{}", err.what());
+							number = std::stoi(command.substr(1));
+						} catch (const std::invalid_argument&) {
+							number = -1;
 						}
+						if (number >= 0 && number <= 9) {
+							encoder.setCompressionLevel(number);
+						} else spdlog::error("Invalid number");
 					}
 				} else if (command == "explorer") {
 #ifdef __WIN32__
@@ -190,27 +660,39 @@ void update(space_t& space) {
 		SDL_Point mousePos;
 		auto mouseState = SDL_GetMouseState(&mousePos.x, &mousePos.y);
 
-		if (screenDirty || controller.arePixelsDirty()) {
+		// Redrawing, at most once per frame
+		if ((screenDirty || controller.arePixelsDirty()) && start >= nextFrame) {
+			nextFrame = start + FRAME_INTERVAL;
 			SDL_FillRect(surface, nullptr, 0);
-			space.drawDebug(surface, (mouseState & SDL_BUTTON_LMASK) > 0, mousePos, [&controller, surface, pixelsPerUnit](const SDL_Rect& rect, double zoom) {
-				controller.drawPreview(surface, rect, zoom / (double)pixelsPerUnit);
+			// The frame of a sequence is shown instead of the space it is made from
+			auto& shown = sequence ? *sequence->frameSpace : *space;
+			shown.drawDebug(surface, (mouseState & SDL_BUTTON_LMASK) > 0, mousePos, [&controller, &shown, surface, pixelsPerUnit](const SDL_Rect& rect, double zoom) {
+				// The rect shows the whole space, the image only the region
+				auto region = controller.getRegion(shown);
+				SDL_Rect target = {
+					rect.x + (int)std::floor(region.origin.x * zoom),
+					rect.y + (int)std::floor(region.origin.y * zoom),
+					(int)std::ceil(region.size.x * zoom),
+					(int)std::ceil(region.size.y * zoom)
+				};
+				controller.drawPreview(surface, target, zoom / (double)pixelsPerUnit);
 			});
 			SDL_UpdateWindowSurface(window.get());
 
 			screenDirty = false;
 		}
 
-		auto end = std::chrono::high_resolution_clock::now();
-
-		auto duration = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-		auto delay = 5 - duration;
-		if (delay > 0) {
-			SDL_Delay(delay);
-		}
+		// Waiting for an event. While rendering the loop wakes up sooner, to merge the finished workers and start the next live pass without waiting for a frame
+		SDL_WaitEventTimeout(nullptr, controller.isDone() && !live ? 5 : 1);
 	}
 eventLoopExit:
 	spdlog::info("Event loop ended");
 
+	if (encoder.update() > 0) {
+		spdlog::info("Waiting for saves to finish");
+		encoder.waitAll();
+	}
+
 	*threadActive = false;
 
 	commandThread.detach();
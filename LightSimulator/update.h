@@ -2,4 +2,4 @@
 #include "pch.h"
 #include "space.h"
 
-void update(space_t& space);
\ No newline at end of file
+void update(spaceSnapshot_t space);
\ No newline at end of file
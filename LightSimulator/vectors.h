@@ -3,46 +3,51 @@
 
 using extent_t = double;
 
-struct vec2_t {
-	extent_t x;
-	extent_t y;
-
-	inline vec2_t() : x(0), y(0) {}
-	inline vec2_t(extent_t x_, extent_t y_) : x(x_), y(y_) {}
-	inline vec2_t(const SDL_Point& point) : x(point.x), y(point.y) {}
-
-	inline vec2_t operator +(const vec2_t& other) const {
-		return vec2_t(x + other.x, y + other.y);
+/* Point or direction in the precision T, vec2_t for everything but the single precision march kernels */
+template <typename T>
+struct basicVec2_t {
+	T x;
+	T y;
+
+	inline basicVec2_t() : x(0), y(0) {}
+	inline basicVec2_t(T x_, T y_) : x(x_), y(y_) {}
+	inline basicVec2_t(const SDL_Point& point) : x((T)point.x), y((T)point.y) {}
+	/* Converts from another precision */
+	template <typename U>
+	inline explicit basicVec2_t(const basicVec2_t<U>& other) : x((T)other.x), y((T)other.y) {}
+
+	inline basicVec2_t operator +(const basicVec2_t& other) const {
+		return basicVec2_t(x + other.x, y + other.y);
 	}
 
-	inline vec2_t operator -(const vec2_t& other) const {
-		return vec2_t(x - other.x, y - other.y);
+	inline basicVec2_t operator -(const basicVec2_t& other) const {
+		return basicVec2_t(x - other.x, y - other.y);
 	}
 
-	inline vec2_t operator *(const vec2_t& other) const {
-		return vec2_t(x * other.x, y * other.y);
+	inline basicVec2_t operator *(const basicVec2_t& other) const {
+		return basicVec2_t(x * other.x, y * other.y);
 	}
 
-	inline vec2_t operator *(extent_t other) const {
-		return vec2_t(x * other, y * other);
+	inline basicVec2_t operator *(T other) const {
+		return basicVec2_t(x * other, y * other);
 	}
 
-	inline vec2_t operator -() const {
-		return vec2_t(-x, -y);
+	inline basicVec2_t operator -() const {
+		return basicVec2_t(-x, -y);
 	}
 
-	inline vec2_t perpendicular() const {
-		return vec2_t(
+	inline basicVec2_t perpendicular() const {
+		return basicVec2_t(
 			-y * 1,
 			x * 1
 		);
 	}
 
-	inline extent_t length() const {
+	inline T length() const {
 		return std::sqrt(x * x + y * y);
 	}
 
-	inline vec2_t normalize() const {
+	inline basicVec2_t normalize() const {
 		return *this * (1 / length());
 	}
 
@@ -53,20 +58,74 @@ struct vec2_t {
 	inline bool isZero() const {
 		return x == 0 && y == 0;
 	}
+
+	inline bool operator ==(const basicVec2_t& other) const {
+		return x == other.x && y == other.y;
+	}
+
+	inline bool operator !=(const basicVec2_t& other) const {
+		return !(*this == other);
+	}
 };
 
-inline extent_t dot(const vec2_t& a, const vec2_t& b) {
+using vec2_t = basicVec2_t<extent_t>;
+using vec2f_t = basicVec2_t<float>;
+
+template <typename T>
+inline T dot(const basicVec2_t<T>& a, const basicVec2_t<T>& b) {
 	return a.x * b.x + a.y * b.y;
 }
 
-inline vec2_t reflect(const vec2_t& dir, const vec2_t& normal) {
+template <typename T>
+inline basicVec2_t<T> reflect(const basicVec2_t<T>& dir, const basicVec2_t<T>& normal) {
 	return dir - (normal * (dot(dir, normal) * 2));
 }
 
-inline vec2_t lerp(const vec2_t& a, const vec2_t& b, extent_t t) {
+template <typename T>
+inline basicVec2_t<T> lerp(const basicVec2_t<T>& a, const basicVec2_t<T>& b, std::type_identity_t<T> t) {
 	return a + ((b - a) * t);
 }
 
+/* The rectangle of the space an image shows, in space coordinates */
+struct region_t {
+	vec2_t origin;
+	vec2_t size;
+
+	inline bool contains(const vec2_t& point) const {
+		return point.x >= origin.x && point.y >= origin.y && point.x <= origin.x + size.x && point.y <= origin.y + size.y;
+	}
+
+	/* Cuts the segment to the part inside the region, returns false if no part of it is inside */
+	inline bool clip(vec2_t& from, vec2_t& to) const {
+		if (contains(from) && contains(to)) return true;
+		// Liang-Barsky, the segment is from + delta * t for t between t0 and t1
+		extent_t t0 = 0;
+		extent_t t1 = 1;
+		auto delta = to - from;
+		auto edge = [&](extent_t p, extent_t q) {
+			if (p == 0) return q >= 0;
+			auto t = q / p;
+			if (p < 0) {
+				if (t > t1) return false;
+				if (t > t0) t0 = t;
+			} else {
+				if (t < t0) return false;
+				if (t < t1) t1 = t;
+			}
+			return true;
+		};
+		if (
+			!edge(-delta.x, from.x - origin.x) || !edge(delta.x, origin.x + size.x - from.x) ||
+			!edge(-delta.y, from.y - origin.y) || !edge(delta.y, origin.y + size.y - from.y)
+			) return false;
+		to = from + delta * t1;
+		from = from + delta * t0;
+		return true;
+	}
+
+	bool operator==(const region_t& other) const = default;
+};
+
 struct color_t {
 	extent_t r;
 	extent_t g;
@@ -108,6 +167,14 @@ struct color_t {
 		};
 	}
 
+	inline bool operator==(const color_t& other) const {
+		return r == other.r && g == other.g && b == other.b;
+	}
+
+	inline bool operator!=(const color_t& other) const {
+		return !(*this == other);
+	}
+
 	inline extent_t getIntensity() const {
 		return std::sqrt(r * r + g * g + b * b);
 	}
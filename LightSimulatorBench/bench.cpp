@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "bench.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif // _WIN32
+
+double bench::measure(const std::function<double(size_t iterations)>& run, double minTime) {
+	size_t iterations = 1;
+	while (true) {
+		auto time = run(iterations);
+		if (time >= minTime || iterations >= ((size_t)1 << 40)) {
+			return time * 1e9 / (double)iterations;
+		}
+		// Aim a bit over the target so the next run is most likely the last
+		auto factor = time > 0 ? minTime * 1.2 / time : 100.0;
+		if (factor > 100) factor = 100;
+		if (factor < 2) factor = 2;
+		iterations = (size_t)std::ceil((double)iterations * factor);
+	}
+}
+
+void bench::reportHeader() {
+	std::printf("%-40s %16s %16s\n", "benchmark", "ns/op", "photons/s");
+}
+
+void bench::report(const std::string& name, double nsPerOp, double photonsPerOp) {
+	if (photonsPerOp > 0) {
+		std::printf("%-40s %16.1f %16.0f\n", name.c_str(), nsPerOp, photonsPerOp / nsPerOp * 1e9);
+	} else {
+		std::printf("%-40s %16.1f %16s\n", name.c_str(), nsPerOp, "-");
+	}
+	std::fflush(stdout);
+}
+
+space_t bench::makeSyntheticSpace(size_t segmentCount, uint32_t seed) {
+	space_t space;
+	std::mt19937 random(seed);
+	auto position = std::uniform_real_distribution<extent_t>(0, 100);
+	auto length = std::uniform_real_distribution<extent_t>(1, 10);
+	auto angle = std::uniform_real_distribution<extent_t>(0, 6.283185307179586);
+	auto channel = std::uniform_real_distribution<extent_t>(0.3, 0.9);
+
+	space.size = vec2_t(100, 100);
+	auto& lines = space.objectHolder_t<line_t>::items;
+	lines.reserve(segmentCount);
+	for (size_t i = 0; i < segmentCount; i++) {
+		auto a = vec2_t(position(random), position(random));
+		auto theta = angle(random);
+		auto& line = lines.emplace_back(a, a + vec2_t(std::cos(theta), std::sin(theta)) * length(random));
+		line.reflectivity = color_t(channel(random), channel(random), channel(random));
+		line.roughness = i % 2 == 0 ? 0 : 0.5;
+	}
+
+	auto& spawner = space.spawners.emplace_back();
+	spawner.type = spawner_t::type_e::square;
+	spawner.pos = vec2_t(50, 50);
+	spawner.size = vec2_t(10, 10);
+	spawner.color = color_t(1, 1, 1);
+	spawner.ratio = 1;
+	space.normalizeSpawners();
+
+	return space;
+}
+
+size_t bench::getMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.WorkingSetSize;
+#else
+	// The total and the resident size in pages
+	std::ifstream file("/proc/self/statm");
+	size_t total = 0;
+	size_t resident = 0;
+	if (!(file >> total >> resident)) return 0;
+	return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif // _WIN32
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "pch.h"
+#include "space.h"
+#include "rendering.h"
+
+namespace bench {
+	using steadyClock_t = std::chrono::steady_clock;
+
+	inline double secondsSince(const steadyClock_t::time_point& start) {
+		return std::chrono::duration<double>(steadyClock_t::now() - start).count();
+	}
+
+	/*
+		Calls the function with a growing amount of iterations until the measured time is at least minTime.
+		The function runs the amount of iterations and returns the seconds it took, so it can leave out its setup.
+		Returns nanoseconds per iteration.
+	*/
+	double measure(const std::function<double(size_t iterations)>& run, double minTime = 0.25);
+	/* Prints one line of results, photonsPerOp of zero means the benchmark does not process photons */
+	void report(const std::string& name, double nsPerOp, double photonsPerOp = 0);
+	void reportHeader();
+
+	/* Creates a 100 x 100 room with random segments and one square spawner, the same seed always creates the same room */
+	space_t makeSyntheticSpace(size_t segmentCount, uint32_t seed);
+
+	/* Exposes the internals of the controller that the benchmarks use directly */
+	struct benchController_t : public batchController_t {
+		using batchController_t::pixels;
+
+		inline size_t getWidth() const { return width; }
+		inline size_t getHeight() const { return height; }
+	};
+
+	inline volatile extent_t sink = 0;
+
+	/* Prevents the compiler from removing computations whose results are not used */
+	inline void doNotOptimize(extent_t value) {
+		sink = value;
+	}
+
+	/* Returns the resident set size of the process in bytes, zero if it cannot be read */
+	size_t getMemory();
+}
+
+/* Renders the example scenes, see printUsage in main.cpp for the arguments */
+void runScenes(const std::vector<std::string>& args);
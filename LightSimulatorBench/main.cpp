@@ -0,0 +1,192 @@
+#include "pch.h"
+#undef main
+#include "bench.h"
+#include "rendering.h"
+
+/* Exposes the internals of the worker that the benchmarks call directly */
+struct benchWorker_t : public renderWorker_t {
+	using renderWorker_t::renderWorker_t;
+	using renderWorker_t::executeStep;
+	using renderWorker_t::splat;
+	using renderWorker_t::sortPhotons;
+	using renderWorker_t::photons;
+	using renderWorker_t::randomSource;
+};
+
+static void runKernels(size_t segmentCount) {
+	constexpr size_t POINT_NUM = 1024;
+	constexpr size_t PHOTON_NUM = 10000;
+	constexpr size_t WIDTH = 1000;
+	constexpr size_t HEIGHT = 1000;
+
+	spaceSnapshot_t space = std::make_shared<const space_t>(bench::makeSyntheticSpace(segmentCount, 1));
+	auto& lines = space->objectHolder_t<line_t>::items;
+	std::mt19937 random(2);
+	auto coordinate = std::uniform_real_distribution<extent_t>(0, 100);
+
+	std::vector<vec2_t> points(POINT_NUM);
+	for (auto& point : points) point = vec2_t(coordinate(random), coordinate(random));
+
+	std::printf("Synthetic space with %zu segments\n", lines.size());
+	bench::reportHeader();
+
+	if (!lines.empty()) {
+		bench::report("line_t::getDist", bench::measure([&](size_t iterations) {
+			auto start = bench::steadyClock_t::now();
+			extent_t sum = 0;
+			for (size_t i = 0; i < iterations; i++) {
+				sum += lines[i % lines.size()].getDist(points[i % POINT_NUM]);
+			}
+			bench::doNotOptimize(sum);
+			return bench::secondsSince(start);
+		}));
+	}
+
+	bench::report("objectHolder_t::getClosest", bench::measure([&](size_t iterations) {
+		auto start = bench::steadyClock_t::now();
+		extent_t sum = 0;
+		for (size_t i = 0; i < iterations; i++) {
+			sum += space->objectHolder_t<line_t>::getClosest(points[i % POINT_NUM]).second;
+		}
+		bench::doNotOptimize(sum);
+		return bench::secondsSince(start);
+	}));
+
+	{
+		// The same search in single precision, as the float steps make it
+		floatShapes_t floatShapes;
+		floatShapes.build(*space);
+		bench::report("floatShapes_t::getClosest", bench::measure([&](size_t iterations) {
+			auto start = bench::steadyClock_t::now();
+			extent_t sum = 0;
+			for (size_t i = 0; i < iterations; i++) {
+				sum += floatShapes.getClosest(points[i % POINT_NUM]).second;
+			}
+			bench::doNotOptimize(sum);
+			return bench::secondsSince(start);
+		}));
+	}
+
+	{
+		// A fixed set of photons scattered over the whole room, restored before every step
+		std::vector<photon_t> photonSet(PHOTON_NUM);
+		for (auto& photon : photonSet) {
+			photon.position = vec2_t(coordinate(random), coordinate(random));
+			auto theta = coordinate(random);
+			photon.direction = vec2_t(std::cos(theta), std::sin(theta));
+			photon.color = color_t(1, 1, 1);
+		}
+
+		benchWorker_t worker(space, PHOTON_NUM, WIDTH, HEIGHT);
+		worker.pixels.resize(WIDTH * HEIGHT);
+		worker.randomSource.seed(3);
+		bench::report("renderWorker_t::executeStep", bench::measure([&](size_t iterations) {
+			double time = 0;
+			for (size_t i = 0; i < iterations; i++) {
+				worker.photons = photonSet;
+				auto start = bench::steadyClock_t::now();
+				worker.executeStep();
+				time += bench::secondsSince(start);
+			}
+			return time;
+		}), (double)PHOTON_NUM);
+
+		bench::report("renderWorker_t::sortPhotons", bench::measure([&](size_t iterations) {
+			double time = 0;
+			for (size_t i = 0; i < iterations; i++) {
+				worker.photons = photonSet;
+				auto start = bench::steadyClock_t::now();
+				worker.sortPhotons();
+				time += bench::secondsSince(start);
+			}
+			return time;
+		}), (double)PHOTON_NUM);
+
+		// The same photons in the order of their position
+		worker.photons = photonSet;
+		worker.sortPhotons();
+		auto sortedSet = worker.photons;
+		bench::report("renderWorker_t::executeStep sorted", bench::measure([&](size_t iterations) {
+			double time = 0;
+			for (size_t i = 0; i < iterations; i++) {
+				worker.photons = sortedSet;
+				auto start = bench::steadyClock_t::now();
+				worker.executeStep();
+				time += bench::secondsSince(start);
+			}
+			return time;
+		}), (double)PHOTON_NUM);
+
+		// Segments of the length of a typical step, so the line setup cost is included
+		std::vector<std::pair<vec2_t, vec2_t>> segments(POINT_NUM);
+		auto offset = std::uniform_real_distribution<extent_t>(-2, 2);
+		for (auto& segment : segments) {
+			segment.first = vec2_t(coordinate(random), coordinate(random));
+			segment.second = segment.first + vec2_t(offset(random), offset(random));
+		}
+		auto color = color_t(1, 1, 1);
+		bench::report("renderWorker_t::splat", bench::measure([&](size_t iterations) {
+			auto start = bench::steadyClock_t::now();
+			for (size_t i = 0; i < iterations; i++) {
+				auto& segment = segments[i % POINT_NUM];
+				worker.splat(worker.pixels.data(), segment.first, segment.second, color);
+			}
+			return bench::secondsSince(start);
+		}), 1);
+	}
+
+	{
+		bench::benchController_t controller;
+		controller.resize(WIDTH, HEIGHT);
+		std::vector<color_t> workerPixels(WIDTH * HEIGHT, color_t(0.5, 0.25, 0.125));
+
+		bench::report("reduction_t::merge", bench::measure([&](size_t iterations) {
+			// One reduction of a render with a worker per iteration, the last one also adds the image
+			std::vector<std::vector<color_t>> sums(1, std::vector<color_t>(WIDTH * HEIGHT));
+			reduction_t reduction(std::move(sums), { &controller.pixels }, iterations);
+			std::vector<const std::vector<color_t>*> buffers = { &workerPixels };
+			auto start = bench::steadyClock_t::now();
+			for (size_t i = 0; i < iterations; i++) {
+				reduction.merge(buffers, i);
+			}
+			return bench::secondsSince(start);
+		}));
+
+		bench::report("batchController_t::draw", bench::measure([&](size_t iterations) {
+			auto start = bench::steadyClock_t::now();
+			for (size_t i = 0; i < iterations; i++) {
+				auto surface = controller.draw(0, 0);
+			}
+			return bench::secondsSince(start);
+		}));
+	}
+}
+
+static void printUsage() {
+	std::printf(
+		"Usage: LightSimulatorBench [command]\n"
+		"  kernels [segments]   Microbenchmarks of the hot kernels on a synthetic space (default 1000 segments)\n"
+		"  scenes [directory] [--photons n] [--ppu n] [--threads n] [--seed n] [--sort n] [--update]\n"
+		"                       Renders every scene in the directory (default Examples) and compares them with the\n"
+		"                       reference images in its reference folder, --update writes the references instead\n"
+	);
+}
+
+int main(int argc, char** argv) try {
+	std::vector<std::string> args(argv + 1, argv + argc);
+	if (args.empty() || args[0] == "kernels") {
+		size_t segmentCount = 1000;
+		if (args.size() > 1) segmentCount = (size_t)std::stoull(args[1]);
+		runKernels(segmentCount);
+	} else if (args[0] == "scenes") {
+		runScenes(std::vector<std::string>(args.begin() + 1, args.end()));
+	} else {
+		printUsage();
+		return 1;
+	}
+
+	return 0;
+} catch (const std::exception & err) {
+	spdlog::critical(err.what());
+	return 1;
+}
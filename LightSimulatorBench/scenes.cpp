@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "bench.h"
+#include "exceptions.h"
+
+namespace {
+	struct options_t {
+		std::filesystem::path directory = "Examples";
+		size_t photonNum = 200000;
+		double pixelsPerUnit = 2;
+		size_t threadCount = 4;
+		std::mt19937::result_type seed = 1;
+		/* Steps between sorting the photons, zero to not sort them */
+		size_t sortInterval = 0;
+		bool update = false;
+	};
+
+	/* Image normalized by the amount of photons, so renders with different budgets can be compared */
+	struct image_t {
+		size_t width = 0;
+		size_t height = 0;
+		std::vector<float> data;
+	};
+
+	/* Writes the image as a Portable Float Map, rows are stored bottom to top */
+	void writePfm(const std::filesystem::path& path, const image_t& image) {
+		std::ofstream file;
+		file.open(path, std::ios::binary);
+		if (file.fail()) throw except::fileOpenFail_ex(std::filesystem::absolute(path).string(), errno);
+
+		// Negative scale means little endian
+		file << "PF\n" << image.width << " " << image.height << "\n-1.0\n";
+		for (size_t y = image.height; y-- > 0;) {
+			file.write((const char*)(image.data.data() + y * image.width * 3), image.width * 3 * sizeof(float));
+		}
+	}
+
+	std::optional<image_t> readPfm(const std::filesystem::path& path) {
+		std::ifstream file;
+		file.open(path, std::ios::binary);
+		if (file.fail()) return std::nullopt;
+
+		image_t image;
+		std::string magic;
+		double scale;
+		file >> magic >> image.width >> image.height >> scale;
+		file.get();
+		if (magic != "PF" || scale >= 0 || file.fail()) throw std::runtime_error("Unsupported reference image " + path.string());
+
+		image.data.resize(image.width * image.height * 3);
+		for (size_t y = image.height; y-- > 0;) {
+			file.read((char*)(image.data.data() + y * image.width * 3), image.width * 3 * sizeof(float));
+		}
+		if (file.fail()) throw std::runtime_error("Truncated reference image " + path.string());
+		return image;
+	}
+
+	/* Root mean square error relative to the mean of the reference, so the value does not depend on the brightness of the scene */
+	double getRelativeRmse(const image_t& image, const image_t& reference) {
+		double errorSum = 0;
+		double referenceSum = 0;
+		for (size_t i = 0, len = image.data.size(); i < len; i++) {
+			double difference = (double)image.data[i] - (double)reference.data[i];
+			errorSum += difference * difference;
+			referenceSum += reference.data[i];
+		}
+		auto count = (double)image.data.size();
+		auto mean = referenceSum / count;
+		if (mean == 0) return 0;
+		return std::sqrt(errorSum / count) / mean;
+	}
+
+	options_t parseOptions(const std::vector<std::string>& args) {
+		options_t options;
+		for (size_t i = 0; i < args.size(); i++) {
+			auto& arg = args[i];
+			auto next = [&]() -> const std::string& {
+				if (i + 1 >= args.size()) throw std::invalid_argument("Missing value for " + arg);
+				return args[++i];
+			};
+
+			if (arg == "--photons") options.photonNum = (size_t)std::stoull(next());
+			else if (arg == "--ppu") options.pixelsPerUnit = std::stod(next());
+			else if (arg == "--threads") options.threadCount = (size_t)std::stoull(next());
+			else if (arg == "--seed") options.seed = (std::mt19937::result_type)std::stoul(next());
+			else if (arg == "--sort") options.sortInterval = (size_t)std::stoull(next());
+			else if (arg == "--update") options.update = true;
+			else if (arg.rfind("--", 0) == 0) throw std::invalid_argument("Unknown option " + arg);
+			else options.directory = arg;
+		}
+
+		if (options.photonNum == 0 || options.pixelsPerUnit <= 0 || options.threadCount == 0) throw std::invalid_argument("Invalid number");
+		return options;
+	}
+}
+
+void runScenes(const std::vector<std::string>& args) {
+	auto options = parseOptions(args);
+	auto referenceDirectory = options.directory / "reference";
+
+	std::vector<std::filesystem::path> scenes;
+	for (auto& entry : std::filesystem::directory_iterator(options.directory)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".json") scenes.push_back(entry.path());
+	}
+	std::sort(scenes.begin(), scenes.end());
+	if (options.update) std::filesystem::create_directories(referenceDirectory);
+
+	std::printf("%zu photons, %g pixels per unit, %zu threads, seed %u, sort every %zu steps\n", options.photonNum, options.pixelsPerUnit, options.threadCount, (unsigned)options.seed, options.sortInterval);
+	std::printf("%-24s %10s %14s %12s %14s %12s\n", "scene", "time [s]", "photons/s", "steps/photon", "peak RSS [MB]", "rel. RMSE");
+
+	for (auto& scenePath : scenes) {
+		auto name = scenePath.stem().string();
+		auto space = std::make_shared<space_t>();
+		try {
+			space->loadFromFile(scenePath);
+		} catch (const std::exception & err) {
+			std::printf("%-24s failed to load: %s\n", name.c_str(), err.what());
+			continue;
+		}
+
+		bench::benchController_t controller;
+		controller.setSortInterval(options.sortInterval);
+		controller.resize(
+			(size_t)std::ceil(space->size.x * options.pixelsPerUnit),
+			(size_t)std::ceil(space->size.y * options.pixelsPerUnit)
+		);
+
+		// The peak of the process would be the one of the biggest scene so far, so the resident set is sampled while this one renders
+		auto peakMemory = bench::getMemory();
+		auto start = bench::steadyClock_t::now();
+		controller.startRendering(space, options.photonNum, options.threadCount, options.seed);
+		while (!controller.isDone()) {
+			controller.update();
+			peakMemory = std::max(peakMemory, bench::getMemory());
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		auto time = bench::secondsSince(start);
+		peakMemory = std::max(peakMemory, bench::getMemory());
+
+		image_t image;
+		image.width = controller.getWidth();
+		image.height = controller.getHeight();
+		image.data.resize(image.width * image.height * 3);
+		auto source = (const extent_t*)controller.pixels.data();
+		for (size_t i = 0, len = image.data.size(); i < len; i++) {
+			image.data[i] = (float)(source[i] / (double)options.photonNum);
+		}
+
+		auto referencePath = referenceDirectory / (name + ".pfm");
+		std::string rmse = "-";
+		if (options.update) {
+			writePfm(referencePath, image);
+			rmse = "updated";
+		} else if (auto reference = readPfm(referencePath)) {
+			if (reference->width != image.width || reference->height != image.height) rmse = "size differs";
+			else rmse = std::to_string(getRelativeRmse(image, *reference));
+		}
+
+		std::printf("%-24s %10.3f %14.0f %12.2f %14.1f %12s\n",
+			name.c_str(),
+			time,
+			(double)options.photonNum / time,
+			(double)controller.getStats().marchSteps / (double)options.photonNum,
+			(double)peakMemory / (1024.0 * 1024.0),
+			rmse.c_str()
+		);
+		std::fflush(stdout);
+	}
+}